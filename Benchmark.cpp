@@ -0,0 +1,547 @@
+/*
+	Benchmarks of the output paths
+		g++ -std=c++17 -O2 Benchmark.cpp -o Benchmark -pthread
+		Benchmark [--json] [--quick]
+
+	Console benchmarks run against the null device and, where there are ptys, against the slave side
+	of a pty pair drained by a thread. The null device drops the bytes without reading them, so the
+	Console throughput is also measured against a sink that adds up every byte (target "checksum")
+	and whose sum is checked against the expected output; that is the number to compare with memcpy.
+	Results are printed as MB/s and ns/op, --json prints one object per line instead (name, target,
+	unit "bytes/s" or "ns/op", value) for tracking trends.
+	--quick runs fewer rounds and skips the 1 GB sink benchmark. Exits with 1 when a check failed.
+*/
+#include "Terminal.hpp"
+#include "VirtualTerminal.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#endif
+
+using namespace terminal;
+
+#if defined(_WIN32)
+static const char* NullDevice = "NUL";
+#else
+static const char* NullDevice = "/dev/null";
+#endif
+
+static bool JsonOutput = false;
+static bool Failed = false;
+
+static double seconds(std::chrono::steady_clock::duration duration)
+{
+	return std::chrono::duration<double>(duration).count();
+}
+
+static void printResult(const char* name, const char* target, const char* unit, double value)
+{
+	if (JsonOutput) {
+		std::printf("{\"name\": \"%s\", \"target\": \"%s\", \"unit\": \"%s\", \"value\": %.3f}\n",
+			name, target ? target : "memory", unit, value);
+		return;
+	}
+	char label[96];
+	std::snprintf(label, sizeof(label), target ? "%s (%s)" : "%s", name, target);
+	if (std::strcmp(unit, "bytes/s") == 0) {
+		std::printf("%-44s %10.1f MB/s\n", label, value / (1024.0 * 1024.0));
+	} else {
+		std::printf("%-44s %10.1f ns/op\n", label, value);
+	}
+}
+
+static void report(const char* name, std::size_t bytes, double elapsed, const char* target = nullptr)
+{
+	printResult(name, target, "bytes/s", bytes / elapsed);
+}
+
+static void reportOps(const char* name, std::size_t ops, double elapsed, const char* target = nullptr)
+{
+	printResult(name, target, "ns/op", elapsed * 1e9 / ops);
+}
+
+// Where the Console benchmarks write: the null device or the slave side of a pty drained by a thread
+class Target {
+private:
+	const char* m_name;
+	std::FILE* m_file = nullptr;
+	int m_fd = -1;
+	int m_master = -1;
+	std::thread m_drain;
+public:
+	static Target null() { return Target("null"); }
+
+	static bool hasPty()
+	{
+#if defined(_WIN32)
+		return false;
+#else
+		return true;
+#endif
+	}
+
+	static Target pty()
+	{
+		Target target("pty");
+#if !defined(_WIN32)
+		target.m_master = ::posix_openpt(O_RDWR | O_NOCTTY);
+		if (target.m_master >= 0 && ::grantpt(target.m_master) == 0 && ::unlockpt(target.m_master) == 0) {
+			target.m_fd = ::open(::ptsname(target.m_master), O_RDWR | O_NOCTTY);
+		}
+		if (target.m_fd >= 0) {
+			int master = target.m_master;
+			target.m_drain = std::thread([master] {
+				char data[64 * 1024];
+				while (::read(master, data, sizeof(data)) > 0) {
+				}
+			});
+		}
+#endif
+		return target;
+	}
+
+	Target(Target&& other) :
+		m_name(other.m_name), m_file(other.m_file), m_fd(other.m_fd), m_master(other.m_master), m_drain(std::move(other.m_drain))
+	{
+		other.m_file = nullptr;
+		other.m_fd = -1;
+		other.m_master = -1;
+	}
+
+	~Target()
+	{
+		if (m_file) {
+			std::fclose(m_file);
+			return;
+		}
+#if !defined(_WIN32)
+		// The drain thread sees the end once the slave side is closed
+		if (m_fd >= 0) {
+			::close(m_fd);
+		}
+		if (m_drain.joinable()) {
+			m_drain.join();
+		}
+		if (m_master >= 0) {
+			::close(m_master);
+		}
+#endif
+	}
+
+	const char* name() const { return m_name; }
+	int fd() const { return m_fd; }
+	bool isOpen() const { return m_fd >= 0; }
+
+private:
+	explicit Target(const char* name) : m_name(name)
+	{
+		if (std::strcmp(name, "null") == 0) {
+			m_file = std::fopen(NullDevice, "wb");
+			m_fd = m_file ? fileno(m_file) : -1;
+		}
+	}
+};
+
+static std::uint64_t checksum(const char* data, std::size_t size)
+{
+	std::uint64_t sum = 0;
+	for (std::size_t i = 0; i < size; i++) {
+		sum += (unsigned char)data[i];
+	}
+	return sum;
+}
+
+// Reads every byte written like a terminal would, the sum shows whether the whole output arrived
+class ChecksumSink : public Sink {
+private:
+	std::uint64_t m_sum = 0;
+	std::size_t m_size = 0;
+public:
+	virtual bool write(const char* data, std::size_t size)
+	{
+		m_sum += checksum(data, size);
+		m_size += size;
+		return true;
+	}
+
+	std::uint64_t sum() const { return m_sum; }
+	std::size_t size() const { return m_size; }
+};
+
+// Multi-megabyte nested dump: many short lines written as one block per record
+static std::string makeDump(std::size_t size)
+{
+	std::string dump;
+	dump.reserve(size);
+	for (int i = 0; dump.size() < size; i++) {
+		dump += "field_";
+		dump += std::to_string(i);
+		dump += " = value of the field number ";
+		dump += std::to_string(i * 7);
+		dump += "\n";
+	}
+	return dump;
+}
+
+static void benchMemcpy(const std::string& dump, int rounds)
+{
+	std::vector<char> target(dump.size());
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < rounds; i++) {
+		std::memcpy(target.data(), dump.data(), dump.size());
+		asm volatile("" : : "r"(target.data()) : "memory");
+	}
+	report("memcpy", dump.size() * rounds, seconds(std::chrono::steady_clock::now() - start));
+}
+
+static void benchPerCharacter(const std::string& dump, int rounds, int level)
+{
+	// The way Console::overflow used to write: one call per character, indentation one space at a time
+	std::FILE* file = std::fopen(NullDevice, "wb");
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < rounds; i++) {
+		for (char c : dump) {
+			std::fputc(c, file);
+			if (c == '\n') {
+				for (int j = 0; j < level * 4; j++) {
+					std::fputc(' ', file);
+				}
+			}
+		}
+	}
+	std::fflush(file);
+	report(level > 0 ? "per character (indented)" : "per character", dump.size() * rounds, seconds(std::chrono::steady_clock::now() - start), "null");
+	std::fclose(file);
+}
+
+// Seconds taken to write the dump rounds times at the indentation level and to flush it
+static double writeDump(Console& con, const std::string& dump, int rounds, int level)
+{
+	for (int i = 0; i < level; i++) {
+		con.enterLevel();
+	}
+	auto start = std::chrono::steady_clock::now();
+	// Written in slices so the plain case goes through the buffer rather than straight to write
+	std::string_view view(dump);
+	for (int i = 0; i < rounds; i++) {
+		for (std::size_t offset = 0; offset < view.size(); offset += 4096) {
+			con << view.substr(offset, 4096);
+		}
+	}
+	con.flush();
+	return seconds(std::chrono::steady_clock::now() - start);
+}
+
+static void benchConsole(const char* name, Target& target, const std::string& dump, int rounds, int level, bool strip = false)
+{
+	Console con(target.fd(), FlushPolicy::Full);
+	con.setStripEscapes(strip);
+	double elapsed = writeDump(con, dump, rounds, level);
+	report(name, dump.size() * rounds, elapsed, target.name());
+}
+
+static void benchConsoleChecksum(const char* name, const std::string& dump, int rounds, int level)
+{
+	ChecksumSink sink;
+	Console con(sink, FlushPolicy::Full);
+	double elapsed = writeDump(con, dump, rounds, level);
+
+	// Every newline is followed by the indentation
+	std::size_t indented = (std::size_t)std::count(dump.begin(), dump.end(), '\n') * rounds * level * 4;
+	std::size_t size = dump.size() * rounds + indented;
+	std::uint64_t sum = checksum(dump.data(), dump.size()) * rounds + indented * ' ';
+	if (sink.size() != size || sink.sum() != sum) {
+		std::printf("%s: %zu bytes with sum %llu arrived, %zu bytes with sum %llu were expected\n", name,
+			sink.size(), (unsigned long long)sink.sum(), size, (unsigned long long)sum);
+		Failed = true;
+	}
+	report(name, size, elapsed, "checksum");
+}
+
+static void benchStrip(const std::string& dump, int rounds)
+{
+	// Same text with a color change on every line
+	std::string colored;
+	for (std::size_t offset = 0; offset < dump.size();) {
+		std::size_t end = dump.find('\n', offset);
+		end = end == std::string::npos ? dump.size() : end + 1;
+		colored += "\x1b[31m";
+		colored.append(dump, offset, end - offset);
+		colored += "\x1b[m";
+		offset = end;
+	}
+
+	std::vector<char> target(colored.size());
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < rounds; i++) {
+		stripEscapes(dump.data(), dump.size(), target.data());
+		asm volatile("" : : "r"(target.data()) : "memory");
+	}
+	report("stripEscapes (plain)", dump.size() * rounds, seconds(std::chrono::steady_clock::now() - start));
+
+	start = std::chrono::steady_clock::now();
+	for (int i = 0; i < rounds; i++) {
+		stripEscapes(colored.data(), colored.size(), target.data());
+		asm volatile("" : : "r"(target.data()) : "memory");
+	}
+	report("stripEscapes (colored)", colored.size() * rounds, seconds(std::chrono::steady_clock::now() - start));
+}
+
+static void benchReplay(const std::string& dump, int rounds)
+{
+	// Colored log lines interpreted by the headless terminal, scrolling on every line
+	std::string colored;
+	for (std::size_t offset = 0; offset < dump.size();) {
+		std::size_t end = dump.find('\n', offset);
+		end = end == std::string::npos ? dump.size() : end + 1;
+		colored += "\x1b[31;1m";
+		colored.append(dump, offset, end - offset);
+		colored += "\x1b[m";
+		offset = end;
+	}
+
+	VirtualTerminal vt(50, 120);
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < rounds; i++) {
+		vt.write(colored);
+	}
+	report("VirtualTerminal replay", colored.size() * rounds, seconds(std::chrono::steady_clock::now() - start));
+}
+
+// Styled records (a short colored header line and a large colored payload) until total bytes went to the sink
+static std::size_t writeStyled(Console& con, const std::string& payload, std::size_t total)
+{
+	std::size_t written = 0;
+	for (int i = 0; written < total; i++) {
+		con << Style("record").green().bold() << ' ' << i << '\n';
+		con << Style(payload).yellow() << '\n';
+		written += payload.size() + 16;
+	}
+	con.flush();
+	return written;
+}
+
+static void benchSinks(std::size_t total)
+{
+	// Large payloads do not fit the buffer and go out by reference next to it in one writev
+	std::string payload;
+	while (payload.size() < 64 * 1024) {
+		payload += "sink benchmark payload ";
+	}
+	const std::size_t chunk = 64 * 1024 * 1024;
+
+	{
+		std::FILE* file = std::fopen(NullDevice, "wb");
+		{
+			FdSink null(fileno(file));
+			Console con(null, FlushPolicy::Full);
+			con.setStripEscapes(false);
+			auto start = std::chrono::steady_clock::now();
+			std::size_t written = writeStyled(con, payload, total);
+			report("FdSink", written, seconds(std::chrono::steady_clock::now() - start), "null");
+		}
+		std::fclose(file);
+	}
+	{
+		MemorySink memory(chunk + 2 * payload.size());
+		Console con(memory, FlushPolicy::Full);
+		std::size_t written = 0;
+		auto start = std::chrono::steady_clock::now();
+		// Cleared every chunk so the benchmark does not need the whole output in memory
+		while (written < total) {
+			written += writeStyled(con, payload, chunk);
+			memory.clear();
+		}
+		report("MemorySink", written, seconds(std::chrono::steady_clock::now() - start));
+	}
+	{
+		const char* path = "Benchmark.out";
+		{
+			FileSink file(path);
+			Console con(file, FlushPolicy::Full);
+			con.setStripEscapes(false);
+			auto start = std::chrono::steady_clock::now();
+			std::size_t written = writeStyled(con, payload, total);
+			report("FileSink", written, seconds(std::chrono::steady_clock::now() - start), "file");
+		}
+		std::remove(path);
+	}
+}
+
+template <class Insert>
+static void benchInsert(const char* name, Target& target, int count, Insert insert)
+{
+	Console con(target.fd(), FlushPolicy::Full);
+	con.setStripEscapes(false);
+	con.setColorLevel(ColorLevel::TrueColor);
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < count; i++) {
+		insert(con);
+	}
+	con.flush();
+	reportOps(name, count, seconds(std::chrono::steady_clock::now() - start), target.name());
+}
+
+static void benchStyles(Target& target, int count)
+{
+	// Both paths write the same bytes per insert (the runtime Style resets its pen before the
+	// space too), so the difference is the cost of formatting the sequences
+	const std::string_view text = "[Error] Hey this is error";
+
+	benchInsert("Style (runtime)", target, count, [&](Console& con) {
+		con << Style(text).white().bgRed().bold() << ' ';
+	});
+	benchInsert("styled<> (compile time)", target, count, [&](Console& con) {
+		con << styled<TextColor::White, BackgroundColor::Red, Attribute::Bold>(text) << ' ';
+	});
+	benchInsert("Style (true color)", target, count, [&](Console& con) {
+		con << Style(text).color(Color(255, 128, 0)).background(Color(20, 20, 60)) << ' ';
+	});
+	benchInsert("Style (width 40)", target, count, [&](Console& con) {
+		con << Style(text).green().width(40) << ' ';
+	});
+	benchInsert("Style (width 40, right)", target, count, [&](Console& con) {
+		con << Style(text).green().width(40).right() << ' ';
+	});
+	benchInsert("Style (width 40, center)", target, count, [&](Console& con) {
+		con << Style(text).green().width(40).center() << ' ';
+	});
+}
+
+// Encodes into a local buffer, the count varies so nothing can be hoisted out of the loop
+template <class Make>
+static void benchEncode(const char* name, int count, Make make)
+{
+	char sequence[MaxSequenceSize];
+	std::size_t total = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < count; i++) {
+		total += encode(sequence, make(i));
+		asm volatile("" : : "r"(sequence) : "memory");
+	}
+	reportOps(name, count, seconds(std::chrono::steady_clock::now() - start));
+	asm volatile("" : : "r"(total));
+}
+
+static void benchEncoders(int count)
+{
+	benchEncode("encode Cursor::up", count, [](int i) { return Cursor::up((i & 63) + 1); });
+	benchEncode("encode Cursor::down", count, [](int i) { return Cursor::down((i & 63) + 1); });
+	benchEncode("encode Cursor::forward", count, [](int i) { return Cursor::forward((i & 63) + 1); });
+	benchEncode("encode Cursor::backward", count, [](int i) { return Cursor::backward((i & 63) + 1); });
+	benchEncode("encode Cursor::home", count, [](int i) { return Cursor::home((i & 63) + 1, (i & 255) + 1); });
+	benchEncode("encode Cursor::forcePosition", count, [](int i) { return Cursor::forcePosition((i & 63) + 1, (i & 255) + 1); });
+	benchEncode("encode Cursor::saveCursor", count, [](int) { return Cursor::saveCursor(); });
+	benchEncode("encode Cursor::restoreCursor", count, [](int) { return Cursor::restoreCursor(); });
+	benchEncode("encode Cursor::saveCursorAndAttrs", count, [](int) { return Cursor::saveCursorAndAttrs(); });
+	benchEncode("encode Cursor::restoreCursorAndAttrs", count, [](int) { return Cursor::restoreCursorAndAttrs(); });
+	benchEncode("encode Scroll::scrollScreen", count, [](int) { return Scroll::scrollScreen(); });
+	benchEncode("encode Scroll::scrollScreen(start, end)", count, [](int i) { return Scroll::scrollScreen((i & 15) + 1, (i & 63) + 20); });
+	benchEncode("encode Scroll::scrollDown", count, [](int) { return Scroll::scrollDown(); });
+	benchEncode("encode Scroll::scrollUp", count, [](int) { return Scroll::scrollUp(); });
+	benchEncode("encode EraseText::EraseEndOfLine", count, [](int) { return EraseText::EraseEndOfLine; });
+	benchEncode("encode EraseText::EraseStartOfLine", count, [](int) { return EraseText::EraseStartOfLine; });
+	benchEncode("encode EraseText::EraseLine", count, [](int) { return EraseText::EraseLine; });
+	benchEncode("encode EraseText::EraseDown", count, [](int) { return EraseText::EraseDown; });
+	benchEncode("encode EraseText::EraseUp", count, [](int) { return EraseText::EraseUp; });
+	benchEncode("encode EraseText::EraseScreen", count, [](int) { return EraseText::EraseScreen; });
+}
+
+// Both style grids of Example.cpp
+static void writeColorGrid(Console& con)
+{
+	for (TextColor t = TextColor::Start; t <= TextColor::End; t = (TextColor)((int)t + 1)) {
+		for (BackgroundColor b = BackgroundColor::Start; b <= BackgroundColor::End; b = (BackgroundColor)((int)b + 1)) {
+			con << Style("[Style]").color(t).color(b).width(10) << " ";
+		}
+		con << "\n";
+	}
+	for (TextColor t = TextColor::Start; t <= TextColor::End; t = (TextColor)((int)t + 1)) {
+		for (BackgroundColor b = BackgroundColor::Start; b <= BackgroundColor::End; b = (BackgroundColor)((int)b + 1)) {
+			con << Style(" [Style] ").color(t).color(b).bold() << " ";
+		}
+		con << "\n";
+	}
+}
+
+static void benchColorGrid(Target& target, int frames)
+{
+	std::size_t frameSize = 0;
+	{
+		MemorySink memory;
+		Console con(memory, FlushPolicy::Full);
+		con.setColorLevel(ColorLevel::TrueColor);
+		writeColorGrid(con);
+		con.flush();
+		frameSize = memory.size();
+	}
+
+	Console con(target.fd(), FlushPolicy::Full);
+	con.setStripEscapes(false);
+	con.setColorLevel(ColorLevel::TrueColor);
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < frames; i++) {
+		writeColorGrid(con);
+	}
+	con.flush();
+	double elapsed = seconds(std::chrono::steady_clock::now() - start);
+	report("color grid", frameSize * frames, elapsed, target.name());
+	reportOps("color grid frame", frames, elapsed, target.name());
+}
+
+int main(int argc, char** argv)
+{
+	bool quick = false;
+	for (int i = 1; i < argc; i++) {
+		if (std::strcmp(argv[i], "--json") == 0) {
+			JsonOutput = true;
+		} else if (std::strcmp(argv[i], "--quick") == 0) {
+			quick = true;
+		}
+	}
+
+	const std::string dump = makeDump(4 * 1024 * 1024);
+	const int rounds = quick ? 4 : 20;
+	const int count = quick ? 200000 : 2000000;
+
+	std::vector<Target> targets;
+	targets.push_back(Target::null());
+	if (Target::hasPty()) {
+		Target pty = Target::pty();
+		if (pty.isOpen()) {
+			targets.push_back(std::move(pty));
+		}
+	}
+
+	benchMemcpy(dump, rounds);
+	benchPerCharacter(dump, 2, 0);
+	benchPerCharacter(dump, 2, 3);
+	benchConsoleChecksum("Console", dump, rounds, 0);
+	benchConsoleChecksum("Console (indented)", dump, rounds, 3);
+	for (Target& target : targets) {
+		benchConsole("Console", target, dump, rounds, 0);
+		benchConsole("Console (indented)", target, dump, rounds, 3);
+	}
+	benchConsole("Console (stripping escapes)", targets[0], dump, rounds, 0, true);
+	benchStrip(dump, rounds);
+	benchReplay(dump, quick ? 1 : 4);
+	if (!quick) {
+		benchSinks(1024 * 1024 * 1024);
+	}
+
+	for (Target& target : targets) {
+		benchStyles(target, count);
+	}
+	benchEncoders(count * 10);
+	for (Target& target : targets) {
+		benchColorGrid(target, quick ? 200 : 2000);
+	}
+
+	return Failed ? 1 : 0;
+}
@@ -1,4 +1,5 @@
 #include "Terminal.hpp"
+#include "Table.hpp"
 
 using namespace terminal;
 
@@ -43,6 +44,14 @@ int main()
 	con << one.text("Style one")
 		<< two.text("Style two")
 		<< one.text("Again style one");
+	con << "\n\n";
+
+	Table table;
+	table.column(Style().bold()).column(Style().right().green()).column(Style().center().width(10));
+	table.row({ "Name", "Size", "State" });
+	table.row({ "Terminal.hpp", "2100", "changed" });
+	table.row({ "Table.hpp", "230", "new" });
+	table.render(con);
 
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,312 @@
+/*
+	Golden tests of the rendered screen
+		g++ -std=c++17 -O2 Golden.cpp -o Golden -pthread
+		Golden
+
+	Output of the library is written into a VirtualTerminal and compared with the screen it has
+	to leave (text of every row, and pens where they matter) rather than with its bytes, so the
+	tests hold when the encoding of sequences changes. The blocks of Console (notice, error, ...)
+	are the exception: they are compared byte for byte with the runtime Style they replaced.
+	The InputParser is checked by the events it reports for a sequence of input.
+	Exits with 1 when a test failed.
+*/
+#include "Terminal.hpp"
+#include "Table.hpp"
+#include "Screen.hpp"
+#include "VirtualTerminal.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+
+using namespace terminal;
+
+static int Failures = 0;
+
+static void expect(const char* name, const std::string& actual, const std::string& expected)
+{
+	if (actual == expected) {
+		std::printf("%-40s passed\n", name);
+		return;
+	}
+	Failures++;
+	std::printf("%-40s FAILED\n--- expected\n%s\n--- actual\n%s\n---\n", name, expected.c_str(), actual.c_str());
+}
+
+static void expect(const char* name, bool condition)
+{
+	expect(name, condition ? "true" : "false", "true");
+}
+
+static void testStyles()
+{
+	VirtualTerminal vt(3, 20);
+	vt << Style("red").red() << " " << Style("bold").bold() << " " << Style("rgb").color(Color(1, 2, 3)).background(Color(4, 5, 6));
+	expect("styles: text", vt.rowText(0), "red bold rgb");
+	expect("styles: pens", vt.at(0, 0).pen.text == Pen::basic((int)TextColor::Red) &&
+		vt.at(0, 3).pen.isDefault() && vt.at(0, 4).pen.attributes == Pen::Bold &&
+		vt.at(0, 9).pen.text == Pen::rgb(Color(1, 2, 3)) && vt.at(0, 9).pen.background == Pen::rgb(Color(4, 5, 6)));
+	expect("styles: pen reset after text", vt.getPen().isDefault());
+}
+
+static void testStyleResetBeforeCharacter()
+{
+	MemorySink sink;
+	{
+		Console con(sink);
+		con.setColorLevel(ColorLevel::Colors16);
+		con << Style("a").bgRed() << ' ' << Style("b").bgRed() << Style("c").bgBlue() << 'd';
+	}
+	VirtualTerminal vt(1, 10);
+	vt << sink.getData();
+	expect("styles: single character after a style", vt.rowText(0) == "a bcd" && vt.at(0, 1).pen.isDefault() &&
+		vt.at(0, 2).pen.background == Pen::basic((int)BackgroundColor::Red) && vt.at(0, 4).pen.isDefault());
+}
+
+static void testAlignment()
+{
+	VirtualTerminal vt(4, 12);
+	vt << "[" << Style("ab").width(6).left() << "]\n";
+	vt << "[" << Style("ab").width(6).right() << "]\n";
+	vt << "[" << Style("ab").width(6).center() << "]\n";
+	vt << "[" << Style("日本").width(6).center() << "]";
+	expect("alignment", vt.text(),
+		"[ab    ]\n"
+		"[    ab]\n"
+		"[  ab  ]\n"
+		"[ 日本 ]");
+}
+
+static void testCursor()
+{
+	VirtualTerminal vt(5, 10);
+	vt << Cursor::home(3, 4) << "x" << Cursor::up(2) << "u" << Cursor::down(3) << "d" << Cursor::backward(5) << "b";
+	expect("cursor movement", vt.text(),
+		"    u\n"
+		"\n"
+		"   x\n"
+		" b   d\n");
+}
+
+static void testErase()
+{
+	VirtualTerminal vt(3, 10);
+	vt << "0123456789\n0123456789\n0123456789";
+	vt << Cursor::home(1, 5) << EraseText::EraseEndOfLine;
+	vt << Cursor::home(2, 5) << EraseText::EraseStartOfLine;
+	vt << Cursor::home(3, 1) << EraseText::EraseLine;
+	expect("erase", vt.text(),
+		"0123\n"
+		"     56789\n");
+}
+
+static void testScrollRegion()
+{
+	VirtualTerminal vt(5, 10);
+	vt << "top" << Cursor::home(5, 1) << "bottom" << Scroll::scrollScreen(2, 4) << Cursor::home(4, 1);
+	for (int i = 0; i < 5; i++) {
+		vt << "\nline " << i;
+	}
+	expect("scroll region", vt.text(),
+		"top\n"
+		"line 2\n"
+		"line 3\n"
+		"line 4\n"
+		"bottom");
+}
+
+static void testTabs()
+{
+	VirtualTerminal vt(2, 20);
+	vt << "a\tb\tc\n" << Cursor::home(2, 4) << TabControl::SetTab << Cursor::home(2, 1) << "x\ty";
+	expect("tabs", vt.text(),
+		"a       b       c\n"
+		"x  y");
+}
+
+static void testWideCharacters()
+{
+	VirtualTerminal vt(3, 6);
+	vt << "ab日本\n" << "abcde日" << Cursor::home(1, 4) << "x";
+	expect("wide characters", vt.text(),
+		"ab x本\n"
+		"abcde\n"
+		"日");
+	expect("wide characters: cursor", vt.getRow() == 0 && vt.getColumn() == 4);
+}
+
+static void testInterruptedSequence()
+{
+	VirtualTerminal vt(1, 10);
+	vt.write("\x1b[31\x1b[1mab");
+	expect("interrupted CSI", vt.rowText(0), "ab");
+	expect("interrupted CSI: new sequence", vt.at(0, 0).pen.attributes == Pen::Bold && vt.at(0, 0).pen.text == Pen::NoColor);
+}
+
+static void testStripInterruptedSequence()
+{
+	expect("strip: CSI cut off by the next one", stripEscapes("a\x1b[1\x1b[31mb\x1b(\x1b[mc"), "abc");
+	EscapeFilter filter;
+	std::string text;
+	for (char c : std::string("x\x1b[4\x1b[0;31my")) {
+		filter.scan(&c, 1, [&text](const char* data, std::size_t size) {
+			text.append(data, size);
+			return true;
+		});
+	}
+	expect("strip: CSI cut off, byte by byte", text, "xy");
+}
+
+static void testTable()
+{
+	VirtualTerminal vt(4, 30);
+	Table table;
+	table.column(Style().bold()).column(Style().right()).column(Style().center());
+	table.row({ "name", "size", "note" });
+	table.row({ "日本語", "12", "é" });
+	table.row({ "x", "12345", "wide 語" });
+	table.render(vt);
+	expect("table", vt.text(),
+		"name    size  note\n"
+		"日本語    12    é\n"
+		"x      12345 wide 語\n");
+}
+
+static void testScreen()
+{
+	VirtualTerminal vt(3, 8);
+	Screen screen(3, 8);
+	screen.print(0, 0, "hello", Pen());
+	screen.print(1, 2, "日本", Pen());
+	screen.put(2, 7, U'z');
+	screen.present(vt);
+	screen.print(0, 1, "EL");
+	screen.present(vt);
+	expect("screen presents", vt.text(),
+		"hELlo\n"
+		"  日本\n"
+		"       z");
+}
+
+static void testScreenWideCharacters()
+{
+	VirtualTerminal vt(2, 8);
+	Screen screen(2, 8);
+	screen.print(0, 0, "日本x");
+	screen.print(1, 0, "a語b");
+	screen.present(vt);
+	screen.put(0, 5, U'y');
+	screen.put(1, 2, U'c');
+	screen.present(vt);
+	expect("screen: wide characters", vt.text(),
+		"日本xy\n"
+		"a cb");
+	expect("screen: wide character cut in half", screen.at(1, 1).codepoint == U' ');
+	expect("screen: wide character at the edge", screen.print(0, 7, "語") == 7);
+}
+
+// Bytes of a block after prepare() ran, through styled<> (Console::error) or the runtime Style
+static std::string blockBytes(bool compiled, ColorLevel level, void (*prepare)(Console&), const char* text)
+{
+	MemorySink sink;
+	{
+		Console con(sink);
+		con.setColorLevel(level);
+		prepare(con);
+		if (compiled) {
+			con.error(text);
+		} else {
+			con << "\n" << Style(text).bgRed().white().width(80) << "\n";
+		}
+	}
+	return sink.getData();
+}
+
+static void testStyledBlockBytes()
+{
+	void (*prepares[])(Console&) = {
+		[](Console&) {},
+		[](Console& con) { con << "partial"; },
+		[](Console& con) { con << TextColor::Green << "raw color"; },
+		[](Console& con) { con << Attribute::Bold << "raw attribute"; },
+		[](Console& con) { con << Style("pending").bold(); },
+		[](Console& con) { con.enterLevel(); con << "indented\n"; },
+	};
+	const char* texts[] = { "error", "", "two\nlines", "tab\t é 日本", "a text that is longer than the width of eighty columns of the block, so it is not padded" };
+	bool same = true;
+	for (ColorLevel level : { ColorLevel::None, ColorLevel::Colors16, ColorLevel::TrueColor }) {
+		for (auto prepare : prepares) {
+			for (const char* text : texts) {
+				same = same && blockBytes(true, level, prepare, text) == blockBytes(false, level, prepare, text);
+			}
+		}
+	}
+	expect("styled blocks: bytes of the runtime Style", same);
+	expect("styled blocks: notice", blockBytes(true, ColorLevel::Colors16, [](Console&) {}, "x"),
+		"\n\x1b[37;41mx" + std::string(79, ' ') + "\x1b[m\n");
+
+	MemorySink sink;
+	{
+		Console con(sink);
+		con.setColorLevel(ColorLevel::Colors16);
+		con << Style("b").bold() << styled<TextColor::Red>("r") << Attribute::Underscore << styled<TextColor::Blue>("u") << "p";
+	}
+	VirtualTerminal vt(1, 10);
+	vt << sink.getData();
+	expect("styled: pens of the Console are reset", vt.at(0, 1).pen.attributes == 0 && vt.at(0, 1).pen.text == Pen::basic((int)TextColor::Red) &&
+		vt.at(0, 2).pen.attributes == 0 && vt.at(0, 3).pen.isDefault());
+}
+
+// Events of the input fed in chunks of the given size, one per line: text, key:<key>/<modifiers> or device
+static std::string inputEvents(const std::string& input, std::size_t chunk)
+{
+	InputParser parser;
+	std::string events;
+	auto handler = [&events](const InputEvent& event) {
+		if (event.type == InputEvent::Type::Text) {
+			events += "text:" + std::string(event.text) + "\n";
+		} else if (event.type == InputEvent::Type::Key) {
+			events += "key:" + std::to_string((int)event.key) + "/" + std::to_string(event.modifiers) + "\n";
+		} else {
+			events += "device\n";
+		}
+	};
+	for (std::size_t offset = 0; offset < input.size(); offset += chunk) {
+		parser.feed(input.data() + offset, std::min(chunk, input.size() - offset), handler);
+	}
+	parser.flush(handler);
+	return events;
+}
+
+static void testInterruptedInput()
+{
+	std::string up = "key:" + std::to_string((int)Key::Up) + "/0\n";
+	std::string down = "key:" + std::to_string((int)Key::Down) + "/0\n";
+	expect("input: CSI cut off by the next one", inputEvents("\x1b[1\x1b[A", 64), up);
+	expect("input: CSI cut off, byte by byte", inputEvents("\x1b[1;\x1b[Ax", 1), up + "text:x\n");
+	expect("input: overlong CSI cut off", inputEvents("\x1b[1;2;3;4;5;6;7;8;9\x1b[B", 64), down);
+}
+
+int main()
+{
+	testStyles();
+	testStyleResetBeforeCharacter();
+	testAlignment();
+	testCursor();
+	testErase();
+	testScrollRegion();
+	testTabs();
+	testWideCharacters();
+	testInterruptedSequence();
+	testStripInterruptedSequence();
+	testTable();
+	testScreen();
+	testScreenWideCharacters();
+	testStyledBlockBytes();
+	testInterruptedInput();
+	if (Failures > 0) {
+		std::printf("%d failed\n", Failures);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,267 @@
+#pragma once
+
+#include "Terminal.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+/**
+    Live region
+
+    Owns the bottom lines of a Console for progress bars and status lines:
+        LiveRegion progress(con, 2, 20);
+        progress.set(0, "Downloading 42%");
+
+    set() only stores the text and can be called from any thread as often as needed, a frame
+    thread repaints at most fps times a second, only when something changed and only the lines
+    that changed. Output of the Console (and of its per-thread consoles) is written above the
+    region: the region is erased, the complete lines are written and the region is drawn again
+    below them, all in one write. A line without its newline is held back until the newline
+    arrives or the region goes away.
+
+    Lines are plain text, cut to the width of the terminal. When the Console does not write to
+    a terminal nothing is repainted, the last content is written once when the region is destroyed.
+*/
+namespace terminal
+{
+    class LiveRegion : detail::OutputHook {
+    private:
+        Console& m_console;
+        std::shared_ptr<detail::ConsoleLink> m_link;
+        const int m_lines;
+        const std::chrono::nanoseconds m_interval;
+        const bool m_active;
+
+        // Guarded by m_mutex: latest text of every line, set() and the frame thread meet here
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+        std::vector<std::string> m_text;
+        std::vector<std::uint8_t> m_dirty;
+        bool m_changed = false;
+        bool m_stop = false;
+
+        // Guarded by the lock of the Console link: what is on the screen
+        std::vector<std::string> m_shown;
+        std::string m_carry;
+        std::string m_frame;
+        int m_columns;
+        std::uint64_t m_frames = 0;
+
+        // Owned by the frame thread
+        std::vector<std::string> m_snapshot;
+        std::vector<std::uint8_t> m_changedLines;
+
+        std::thread m_thread;
+    public:
+        LiveRegion(Console& console, int lines, int fps = 30) :
+            m_console(console), m_link(console.m_link), m_lines(lines > 0 ? lines : 1),
+            m_interval(std::chrono::nanoseconds(1000000000 / (fps > 0 ? fps : 1))),
+            m_active(!console.m_strip && detail::isTerminal(console.getFd())),
+            m_text((std::size_t)m_lines), m_dirty((std::size_t)m_lines, 0),
+            m_shown((std::size_t)m_lines), m_columns(detail::terminalColumns(console.getFd())),
+            m_snapshot((std::size_t)m_lines), m_changedLines((std::size_t)m_lines, 0)
+        {
+            if (!m_active) {
+                return;
+            }
+            console.flush();
+            {
+                // Makes room for the lines, the cursor stays on the first one
+                std::lock_guard<std::mutex> lock(m_link->mutex);
+                m_frame.assign((std::size_t)m_lines - 1, '\n');
+                appendUp(m_lines - 1);
+                m_link->hook = this;
+                if (!m_frame.empty()) {
+                    console.writeDirect(m_frame.data(), m_frame.size());
+                }
+            }
+            m_thread = std::thread([this] { run(); });
+        }
+
+        // Paints what is still pending and leaves the region on the screen above the cursor.
+        // Nothing is written when the Console was destroyed first.
+        ~LiveRegion() {
+            if (!m_active) {
+                if (!consoleAlive()) {
+                    return;
+                }
+                m_console.flush();
+                for (const std::string& text : m_text) {
+                    m_console << text << "\n";
+                }
+                m_console.flush();
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+            }
+            m_wake.notify_one();
+            m_thread.join();
+
+            if (consoleAlive()) {
+                m_console.flush();
+            }
+            takeChanges();
+            std::lock_guard<std::mutex> lock(m_link->mutex);
+            m_link->hook = nullptr;
+            if (m_link->owner == nullptr) {
+                return;
+            }
+            paint();
+            m_frame.clear();
+            appendDown(m_lines - 1);
+            m_frame += '\n';
+            m_frame += m_carry;
+            m_link->owner->writeDirect(m_frame.data(), m_frame.size());
+        }
+
+        LiveRegion(const LiveRegion&) = delete;
+        LiveRegion& operator=(const LiveRegion&) = delete;
+
+        int getLines() const { return m_lines; }
+
+        // Frames painted so far (scheduled repaints, not output passing the region)
+        std::uint64_t getFrames() const {
+            std::lock_guard<std::mutex> lock(m_link->mutex);
+            return m_frames;
+        }
+
+        // Changes a line, the screen follows with the next frame
+        void set(int line, std::string_view text) {
+            if (line < 0 || line >= m_lines) {
+                return;
+            }
+            bool wake = false;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                std::string& current = m_text[(std::size_t)line];
+                if (current == text) {
+                    return;
+                }
+                current.assign(text.data(), text.size());
+                m_dirty[(std::size_t)line] = 1;
+                wake = !m_changed;
+                m_changed = true;
+            }
+            if (wake) {
+                m_wake.notify_one();
+            }
+        }
+
+    private:
+        // The Console may be destroyed before the region, its link outlives it
+        bool consoleAlive() const {
+            std::lock_guard<std::mutex> lock(m_link->mutex);
+            return m_link->owner != nullptr;
+        }
+
+        void run() {
+            auto last = std::chrono::steady_clock::now() - m_interval;
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while (true) {
+                m_wake.wait(lock, [this] { return m_changed || m_stop; });
+                if (m_stop) {
+                    return;
+                }
+                // Updates arriving before the next frame is due are merged into it
+                if (m_wake.wait_until(lock, last + m_interval, [this] { return m_stop; })) {
+                    return;
+                }
+                last = std::chrono::steady_clock::now();
+                lock.unlock();
+
+                takeChanges();
+                {
+                    std::lock_guard<std::mutex> linkLock(m_link->mutex);
+                    if (m_link->owner != nullptr) {
+                        m_columns = detail::terminalColumns(m_console.getFd(), m_columns);
+                        paint();
+                        m_frames++;
+                    }
+                }
+                lock.lock();
+            }
+        }
+
+        // Copies the changed lines out, so set() is never blocked by a write
+        void takeChanges() {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (std::size_t i = 0; i < m_text.size(); i++) {
+                m_changedLines[i] = m_dirty[i];
+                if (m_dirty[i]) {
+                    m_snapshot[i] = m_text[i];
+                    m_dirty[i] = 0;
+                }
+            }
+            m_changed = false;
+        }
+
+        // Rewrites the changed lines, starting and ending on the first line of the region
+        void paint() {
+            m_frame.clear();
+            int row = 0;
+            for (int i = 0; i < m_lines; i++) {
+                std::size_t index = (std::size_t)i;
+                if (!m_changedLines[index]) {
+                    continue;
+                }
+                m_changedLines[index] = 0;
+                if (m_shown[index] == m_snapshot[index]) {
+                    continue;
+                }
+                m_shown[index] = m_snapshot[index];
+                appendDown(i - row);
+                row = i;
+                m_frame += '\r';
+                appendLine(index);
+                m_frame += "\x1b[K";
+            }
+            if (m_frame.empty()) {
+                return;
+            }
+            appendUp(row);
+            m_frame += '\r';
+            m_link->owner->writeDirect(m_frame.data(), m_frame.size());
+        }
+
+        // Output of the Console: erase the region, write the complete lines, draw the region again
+        virtual bool output(Console& owner, const char* data, std::size_t size) {
+            m_carry.append(data, size);
+            std::size_t end = m_carry.rfind('\n');
+            if (end == std::string::npos) {
+                return true;
+            }
+            m_frame.assign("\r\x1b[J");
+            m_frame.append(m_carry, 0, end + 1);
+            m_carry.erase(0, end + 1);
+            for (int i = 0; i < m_lines; i++) {
+                if (i > 0) {
+                    m_frame += '\n';
+                }
+                appendLine((std::size_t)i);
+            }
+            appendUp(m_lines - 1);
+            m_frame += '\r';
+            return owner.writeDirect(m_frame.data(), m_frame.size());
+        }
+
+        void appendLine(std::size_t index) {
+            std::string_view text = truncateToWidth(m_shown[index], m_columns > 1 ? (std::size_t)m_columns - 1 : 1);
+            m_frame.append(text.data(), text.size());
+        }
+
+        void appendMove(int count, char direction) {
+            if (count <= 0) {
+                return;
+            }
+            char sequence[MaxSequenceSize];
+            m_frame.append(sequence, detail::encodeCsi(sequence, count, direction));
+        }
+
+        void appendUp(int count) { appendMove(count, 'A'); }
+        void appendDown(int count) { appendMove(count, 'B'); }
+    };
+}
@@ -0,0 +1,269 @@
+#pragma once
+
+#include "Terminal.hpp"
+
+#include <atomic>
+
+#if !defined(_WIN32)
+#include <csignal>
+#endif
+
+/**
+    Pinned panes
+
+    Keeps header lines at the top and footer lines at the bottom of the screen while the output
+    of a Console scrolls between them:
+        PinnedPanes panes(con, 1, 1);
+        panes.setHeader(0, "build: 12 of 40");
+        con << "compiling Table.hpp\n";
+
+    The rows between the panes become the scroll region of the terminal (DECSTBM,
+    Scroll::scrollScreen), so a log line scrolls in the terminal itself and costs only its
+    own bytes. Pane lines are rewritten in place between save and restore cursor.
+
+    A resize (SIGWINCH) is noticed before the next output or pane update, the region is set
+    again for the new size and the panes are drawn again. The cursor goes back to the column the
+    output had reached, so a line written in parts is continued rather than overwritten. Windows
+    has no SIGWINCH, call refresh() there after the console was resized.
+
+    Pane lines are plain text cut to the width of the terminal. Nothing is pinned when the
+    Console does not write to a terminal or the screen is too small to leave a row for the
+    output. A Console can have either PinnedPanes or a LiveRegion at a time.
+*/
+namespace terminal
+{
+    namespace detail
+    {
+        // Number of SIGWINCH signals since the first PinnedPanes started watching
+        inline std::atomic<unsigned>& resizeCount() {
+            static std::atomic<unsigned> count(0);
+            return count;
+        }
+
+#if !defined(_WIN32)
+        inline struct sigaction& previousResizeAction() {
+            static struct sigaction action;
+            return action;
+        }
+
+        inline void onResize(int signal, siginfo_t* info, void* context) {
+            resizeCount().fetch_add(1, std::memory_order_relaxed);
+            const struct sigaction& previous = previousResizeAction();
+            if (previous.sa_flags & SA_SIGINFO) {
+                if (previous.sa_sigaction != nullptr) {
+                    previous.sa_sigaction(signal, info, context);
+                }
+            } else if (previous.sa_handler != SIG_DFL && previous.sa_handler != SIG_IGN &&
+                previous.sa_handler != nullptr) {
+                previous.sa_handler(signal);
+            }
+        }
+#endif
+
+        // Installs the SIGWINCH handler once, a handler that was there before is still called (with
+        // the signal info when it asked for it)
+        inline void watchResize() {
+#if !defined(_WIN32)
+            static const bool installed = [] {
+                resizeCount();
+                struct sigaction action;
+                std::memset(&action, 0, sizeof(action));
+                action.sa_sigaction = onResize;
+                sigemptyset(&action.sa_mask);
+                action.sa_flags = SA_RESTART | SA_SIGINFO;
+                return ::sigaction(SIGWINCH, &action, &previousResizeAction()) == 0;
+            }();
+            (void)installed;
+#endif
+        }
+    }
+
+    class PinnedPanes : detail::OutputHook {
+    private:
+        Console& m_console;
+        std::shared_ptr<detail::ConsoleLink> m_link;
+        const int m_header;
+        const int m_footer;
+        const bool m_active;
+
+        // Guarded by the lock of the Console link
+        std::vector<std::string> m_lines;
+        int m_rows = 0;
+        int m_columns = 0;
+        bool m_pinned = false;
+        unsigned m_resizes = 0;
+        std::string m_frame;
+        // Column the output left the cursor in, a new layout puts it back there
+        std::size_t m_column = 0;
+        EscapeFilter m_filter;
+    public:
+        PinnedPanes(Console& console, int headerLines, int footerLines) :
+            m_console(console), m_link(console.m_link),
+            m_header(headerLines > 0 ? headerLines : 0), m_footer(footerLines > 0 ? footerLines : 0),
+            m_active(!console.m_strip && detail::isTerminal(console.getFd())),
+            m_lines((std::size_t)(m_header + m_footer))
+        {
+            if (!m_active) {
+                return;
+            }
+            detail::watchResize();
+            console.flush();
+            std::lock_guard<std::mutex> lock(m_link->mutex);
+            m_link->hook = this;
+            if (m_link->owner != nullptr) {
+                m_frame.clear();
+                appendLayout();
+                m_link->owner->writeDirect(m_frame.data(), m_frame.size());
+            }
+        }
+
+        // Gives the whole screen back to scrolling, the panes stay where they are. Nothing is
+        // written when the Console was destroyed first.
+        ~PinnedPanes() {
+            if (!m_active) {
+                return;
+            }
+            bool alive;
+            {
+                std::lock_guard<std::mutex> lock(m_link->mutex);
+                alive = m_link->owner != nullptr;
+            }
+            if (alive) {
+                m_console.flush();
+            }
+            std::lock_guard<std::mutex> lock(m_link->mutex);
+            m_link->hook = nullptr;
+            if (m_link->owner != nullptr && m_pinned) {
+                m_link->owner->writeDirect("\x1b" "7" "\x1b[r" "\x1b" "8", 7);
+            }
+        }
+
+        PinnedPanes(const PinnedPanes&) = delete;
+        PinnedPanes& operator=(const PinnedPanes&) = delete;
+
+        int getHeaderLines() const { return m_header; }
+        int getFooterLines() const { return m_footer; }
+
+        void setHeader(int line, std::string_view text) {
+            if (line >= 0 && line < m_header) {
+                setLine(line, text);
+            }
+        }
+
+        void setFooter(int line, std::string_view text) {
+            if (line >= 0 && line < m_footer) {
+                setLine(m_header + line, text);
+            }
+        }
+
+        // Reads the size again, sets the scroll region and draws every pane line
+        void refresh() {
+            if (!m_active) {
+                return;
+            }
+            std::lock_guard<std::mutex> lock(m_link->mutex);
+            if (m_link->owner != nullptr) {
+                m_frame.clear();
+                appendLayout();
+                m_link->owner->writeDirect(m_frame.data(), m_frame.size());
+            }
+        }
+
+    private:
+        void setLine(int index, std::string_view text) {
+            std::lock_guard<std::mutex> lock(m_link->mutex);
+            std::string& line = m_lines[(std::size_t)index];
+            line.assign(text.data(), text.size());
+            if (!m_active || m_link->owner == nullptr) {
+                return;
+            }
+            m_frame.clear();
+            if (resized()) {
+                appendLayout();
+            } else if (m_pinned) {
+                m_frame += "\x1b" "7";
+                appendLine(index);
+                m_frame += "\x1b" "8";
+            }
+            if (!m_frame.empty()) {
+                m_link->owner->writeDirect(m_frame.data(), m_frame.size());
+            }
+        }
+
+        virtual bool output(Console& owner, const char* data, std::size_t size) {
+            if (!resized()) {
+                track(data, size);
+                return owner.writeDirect(data, size);
+            }
+            m_frame.clear();
+            appendLayout();
+            m_frame.append(data, size);
+            track(data, size);
+            return owner.writeDirect(m_frame.data(), m_frame.size());
+        }
+
+        // Follows the column of the cursor through the output, only the text after the last line
+        // break matters
+        void track(const char* data, std::size_t size) {
+            const char* start = data + size;
+            while (start > data && start[-1] != '\n' && start[-1] != '\r') {
+                start--;
+            }
+            if (start > data) {
+                m_column = 0;
+                m_filter.reset();
+            }
+            m_filter.scan(start, (std::size_t)(data + size - start), [this](const char* text, std::size_t length) {
+                m_column += displayWidth(std::string_view(text, length));
+                return true;
+            });
+            if (m_columns > 0) {
+                m_column %= (std::size_t)m_columns;
+            }
+        }
+
+        bool resized() {
+            return detail::resizeCount().load(std::memory_order_relaxed) != m_resizes;
+        }
+
+        // Sets the scroll region for the current size, draws the panes and puts the cursor
+        // on the last row of the region, in the column the output had reached
+        void appendLayout() {
+            m_resizes = detail::resizeCount().load(std::memory_order_relaxed);
+            int rows = 24;
+            int columns = 80;
+            detail::terminalSize(m_console.getFd(), rows, columns);
+            m_rows = rows;
+            m_columns = columns;
+
+            int last = m_rows - m_footer;
+            if (last <= m_header + 1) {
+                if (m_pinned) {
+                    m_frame += "\x1b" "7" "\x1b[r" "\x1b" "8";
+                }
+                m_pinned = false;
+                return;
+            }
+            m_pinned = true;
+            char sequence[MaxSequenceSize];
+            m_frame.append(sequence, encode(sequence, Scroll::scrollScreen(m_header + 1, last)));
+            for (int index = 0; index < m_header + m_footer; index++) {
+                appendLine(index);
+            }
+            std::size_t column = std::min(m_column, (std::size_t)m_columns - 1);
+            m_frame.append(sequence, encode(sequence, Cursor::home(last, (int)column + 1)));
+        }
+
+        void appendLine(int index) {
+            int row = index < m_header ? index + 1 : m_rows - m_footer + 1 + (index - m_header);
+            char sequence[MaxSequenceSize];
+            m_frame.append(sequence, encode(sequence, Cursor::home(row, 1)));
+            std::string_view text = truncateToWidth(m_lines[(std::size_t)index], (std::size_t)m_columns);
+            m_frame.append(text.data(), text.size());
+            // A full row leaves the cursor waiting to wrap on the last column, erasing would clear it
+            if (displayWidth(text) < (std::size_t)m_columns) {
+                m_frame += "\x1b[K";
+            }
+        }
+    };
+}
@@ -0,0 +1,646 @@
+#pragma once
+
+#include "VirtualTerminal.hpp"
+
+#include <cstdio>
+#include <thread>
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/**
+    Session recording
+
+    RecordingSink records everything a Console writes together with the time it was written
+    and passes it on to another sink:
+        FdSink out(1);
+        RecordingSink recording(out, "session.rec");
+        Console con(recording);
+
+    Replayer writes a recording to a stream again, at the original speed, faster or at once:
+        Replayer replay("session.rec");
+        replay.seek(con, std::chrono::seconds(90));
+        replay.play(con, 4.0);
+
+    Format (numbers are little endian, varints LEB128):
+        header      "TREC", version (1 byte), rows and columns (varints), start (8 bytes,
+                    microseconds since the epoch)
+        record      type (1 byte), time (varint), size (varint), bytes
+                    Chunk       output as written, time in microseconds since the previous record
+                    Keyframe    rows and columns (varints) and the sequences that redraw the whole
+                                screen (VirtualTerminal::snapshot), time in microseconds since the start
+                    Resize      rows and columns (varints), time like a chunk
+
+    Keyframes are taken every keyframeInterval of recording (none when it is zero) from a
+    VirtualTerminal that follows the output. Their time and offset go to the index file (path
+    + ".idx"), 16 byte entries { time, offset } in time order. Replayer maps the index into
+    memory and finds the last keyframe before a time by binary search, so seeking only plays
+    the output since that keyframe. Keyframes are made of escape sequences, a Console that strips
+    them (one writing to a file or pipe) can not redraw the screen from them.
+
+    A resize is recorded by RecordingSink::resize(), and noticed when a keyframe is due if the target
+    is a terminal; a keyframe follows it right away. Replaying into a VirtualTerminal resizes it at
+    resize records and keyframes, other streams can follow getRows() and getColumns().
+
+    A recording that can not be opened or written does not fail the output to the target, check
+    isOpen() and recordFailed() instead. Without a target the recording is the output.
+*/
+namespace terminal
+{
+    namespace detail
+    {
+        constexpr char RecordingMagic[4] = { 'T', 'R', 'E', 'C' };
+        constexpr std::uint8_t RecordingVersion = 1;
+        constexpr std::size_t IndexEntrySize = 16;
+        constexpr std::uint64_t MaxRecordedSize = 4096;
+
+        enum class RecordType : std::uint8_t {
+            Chunk = 1,
+            Keyframe = 2,
+            Resize = 3
+        };
+
+        // 64 bit offsets, long is 32 bits on Windows
+        inline bool seekFile(std::FILE* file, std::uint64_t offset) {
+#if defined(_WIN32)
+            return _fseeki64(file, (__int64)offset, SEEK_SET) == 0;
+#else
+            return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+        }
+
+        inline std::uint64_t tellFile(std::FILE* file) {
+#if defined(_WIN32)
+            __int64 offset = _ftelli64(file);
+#else
+            off_t offset = ftello(file);
+#endif
+            return offset < 0 ? 0 : (std::uint64_t)offset;
+        }
+
+        inline std::size_t encodeVarint(std::uint64_t value, unsigned char* out) {
+            std::size_t size = 0;
+            while (value >= 0x80) {
+                out[size++] = (unsigned char)(value | 0x80);
+                value >>= 7;
+            }
+            out[size++] = (unsigned char)value;
+            return size;
+        }
+
+        inline bool readVarint(std::FILE* file, std::uint64_t& value) {
+            value = 0;
+            for (int shift = 0; shift < 64; shift += 7) {
+                int c = std::fgetc(file);
+                if (c == EOF) {
+                    return false;
+                }
+                value |= (std::uint64_t)(c & 0x7F) << shift;
+                if ((c & 0x80) == 0) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        inline void encodeFixed(std::uint64_t value, unsigned char* out) {
+            for (int i = 0; i < 8; i++) {
+                out[i] = (unsigned char)(value >> (8 * i));
+            }
+        }
+
+        inline std::uint64_t decodeFixed(const unsigned char* data) {
+            std::uint64_t value = 0;
+            for (int i = 0; i < 8; i++) {
+                value |= (std::uint64_t)data[i] << (8 * i);
+            }
+            return value;
+        }
+    }
+
+    struct RecordingOptions {
+        // Size of the screen for keyframes, taken from the terminal when the target sink writes to one
+        int rows = 24;
+        int columns = 80;
+        std::chrono::milliseconds keyframeInterval{ 5000 };
+    };
+
+    class RecordingSink : public Sink {
+    private:
+        Sink* m_target;
+        std::FILE* m_file = nullptr;
+        std::FILE* m_index = nullptr;
+        RecordingOptions m_options;
+        std::unique_ptr<VirtualTerminal> m_screen;
+        std::chrono::steady_clock::time_point m_start;
+        std::uint64_t m_time = 0;
+        std::uint64_t m_keyframeTime = 0;
+        std::uint64_t m_offset = 0;
+        bool m_recordFailed = false;
+    public:
+        // Records and writes to target
+        RecordingSink(Sink& target, const char* path, RecordingOptions options = RecordingOptions()) :
+            m_target(&target)
+        {
+            open(path, options);
+        }
+
+        // Only records
+        explicit RecordingSink(const char* path, RecordingOptions options = RecordingOptions()) :
+            m_target(nullptr)
+        {
+            open(path, options);
+        }
+
+        ~RecordingSink() {
+            if (m_index) {
+                std::fclose(m_index);
+            }
+            if (m_file) {
+                std::fclose(m_file);
+            }
+        }
+
+        RecordingSink(const RecordingSink&) = delete;
+        RecordingSink& operator=(const RecordingSink&) = delete;
+
+        bool isOpen() const { return m_file != nullptr && m_index != nullptr; }
+        // Output was not recorded, because the files are not open or writing them failed
+        bool recordFailed() const { return m_recordFailed; }
+        std::uint64_t getRecordedBytes() const { return m_offset; }
+
+        // Writes the recording through to disk
+        bool flush() { return isOpen() && std::fflush(m_file) == 0 && std::fflush(m_index) == 0; }
+
+        // Records the new size of the screen, followed by a keyframe when keyframes are taken
+        void resize(int rows, int columns) {
+            if (!isOpen() || (rows == m_options.rows && columns == m_options.columns) || rows <= 0 || columns <= 0) {
+                return;
+            }
+            std::uint64_t now = elapsed();
+            appendResize(now, rows, columns);
+            if (m_screen) {
+                keyframe(now);
+            }
+        }
+
+        virtual bool write(const char* data, std::size_t size) {
+            Segment segment = { data, size };
+            if (m_target == nullptr) {
+                return record(&segment, 1);
+            }
+            bool written = m_target->write(data, size);
+            record(&segment, 1);
+            return written;
+        }
+
+        virtual bool writev(const Segment* segments, std::size_t count) {
+            if (m_target == nullptr) {
+                return record(segments, count);
+            }
+            bool written = m_target->writev(segments, count);
+            record(segments, count);
+            return written;
+        }
+
+        // Only what the target took is recorded
+        virtual long tryWrite(const char* data, std::size_t size) {
+            long written = m_target ? m_target->tryWrite(data, size) : (long)size;
+            if (written > 0) {
+                Segment segment = { data, (std::size_t)written };
+                if (!record(&segment, 1) && m_target == nullptr) {
+                    return -1;
+                }
+            }
+            return written;
+        }
+
+        virtual int getFd() const { return m_target ? m_target->getFd() : -1; }
+
+    private:
+        void open(const char* path, const RecordingOptions& options) {
+            m_options = options;
+            if (m_target) {
+                detail::terminalSize(m_target->getFd(), m_options.rows, m_options.columns);
+            }
+            if (m_options.keyframeInterval.count() > 0) {
+                m_screen.reset(new VirtualTerminal(m_options.rows, m_options.columns));
+            }
+            m_file = std::fopen(path, "wb");
+            std::string index = std::string(path) + ".idx";
+            m_index = m_file ? std::fopen(index.c_str(), "wb") : nullptr;
+            m_start = std::chrono::steady_clock::now();
+            if (!isOpen()) {
+                return;
+            }
+
+            unsigned char header[32];
+            std::size_t size = 0;
+            std::memcpy(header, detail::RecordingMagic, 4);
+            size += 4;
+            header[size++] = detail::RecordingVersion;
+            size += detail::encodeVarint((std::uint64_t)m_options.rows, header + size);
+            size += detail::encodeVarint((std::uint64_t)m_options.columns, header + size);
+            auto epoch = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch());
+            detail::encodeFixed((std::uint64_t)epoch.count(), header + size);
+            size += 8;
+            append(header, size);
+        }
+
+        bool record(const Segment* segments, std::size_t count) {
+            if (!isOpen()) {
+                m_recordFailed = true;
+                return false;
+            }
+            std::uint64_t now = elapsed();
+            std::size_t size = 0;
+            for (std::size_t i = 0; i < count; i++) {
+                size += segments[i].size;
+            }
+            appendHeader(detail::RecordType::Chunk, now - m_time, size);
+            m_time = now;
+            for (std::size_t i = 0; i < count; i++) {
+                append(segments[i].data, segments[i].size);
+                if (m_screen) {
+                    m_screen->write(segments[i].data, segments[i].size);
+                }
+            }
+            if (m_screen && now - m_keyframeTime >= (std::uint64_t)m_options.keyframeInterval.count() * 1000) {
+                int rows = m_options.rows;
+                int columns = m_options.columns;
+                if (m_target && detail::terminalSize(m_target->getFd(), rows, columns) &&
+                    (rows != m_options.rows || columns != m_options.columns)) {
+                    appendResize(now, rows, columns);
+                }
+                keyframe(now);
+            }
+            if (std::ferror(m_file) || std::ferror(m_index)) {
+                m_recordFailed = true;
+            }
+            return !m_recordFailed;
+        }
+
+        std::uint64_t elapsed() const {
+            return (std::uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - m_start).count();
+        }
+
+        // The screen starts over at the new size, as it does when replayed
+        void appendResize(std::uint64_t now, int rows, int columns) {
+            unsigned char size[20];
+            std::size_t length = detail::encodeVarint((std::uint64_t)rows, size);
+            length += detail::encodeVarint((std::uint64_t)columns, size + length);
+            appendHeader(detail::RecordType::Resize, now - m_time, length);
+            append(size, length);
+            m_time = now;
+            m_options.rows = rows;
+            m_options.columns = columns;
+            if (m_screen) {
+                m_screen->resize(rows, columns);
+            }
+        }
+
+        void keyframe(std::uint64_t now) {
+            m_screen->takeResponses();
+            unsigned char size[20];
+            std::size_t length = detail::encodeVarint((std::uint64_t)m_options.rows, size);
+            length += detail::encodeVarint((std::uint64_t)m_options.columns, size + length);
+            std::string snapshot((const char*)size, length);
+            snapshot += m_screen->snapshot();
+
+            unsigned char entry[detail::IndexEntrySize];
+            detail::encodeFixed(now, entry);
+            detail::encodeFixed(m_offset, entry + 8);
+            std::fwrite(entry, 1, sizeof(entry), m_index);
+
+            appendHeader(detail::RecordType::Keyframe, now, snapshot.size());
+            append(snapshot.data(), snapshot.size());
+            m_keyframeTime = now;
+            std::fflush(m_file);
+            std::fflush(m_index);
+        }
+
+        void appendHeader(detail::RecordType type, std::uint64_t time, std::size_t size) {
+            unsigned char header[21];
+            header[0] = (unsigned char)type;
+            std::size_t length = 1;
+            length += detail::encodeVarint(time, header + length);
+            length += detail::encodeVarint((std::uint64_t)size, header + length);
+            append(header, length);
+        }
+
+        void append(const void* data, std::size_t size) {
+            std::fwrite(data, 1, size, m_file);
+            m_offset += size;
+        }
+    };
+
+    class Replayer {
+    private:
+        struct Record {
+            detail::RecordType type;
+            std::uint64_t time;
+            std::string data;
+            // Size carried by keyframes and resizes, the keyframe sequences start at payload
+            int rows;
+            int columns;
+            std::size_t payload;
+        };
+
+        std::FILE* m_file = nullptr;
+        std::uint64_t m_fileSize = 0;
+        std::uint64_t m_first = 0;
+        int m_startRows = 0;
+        int m_startColumns = 0;
+        int m_rows = 0;
+        int m_columns = 0;
+        std::chrono::system_clock::time_point m_started;
+
+        // Index entries, mapped where possible
+        const unsigned char* m_entries = nullptr;
+        std::size_t m_count = 0;
+        std::size_t m_mappedSize = 0;
+        std::vector<unsigned char> m_loaded;
+
+        // Next record to play and the time of the record before it
+        Record m_next;
+        bool m_hasNext = false;
+        std::uint64_t m_time = 0;
+    public:
+        explicit Replayer(const char* path) {
+            m_file = std::fopen(path, "rb");
+            if (m_file && !readHeader()) {
+                std::fclose(m_file);
+                m_file = nullptr;
+            }
+            if (m_file) {
+                openIndex((std::string(path) + ".idx").c_str());
+                m_hasNext = readRecord(m_next);
+            }
+        }
+
+        ~Replayer() {
+#if !defined(_WIN32)
+            if (m_mappedSize > 0) {
+                ::munmap((void*)m_entries, m_mappedSize);
+            }
+#endif
+            if (m_file) {
+                std::fclose(m_file);
+            }
+        }
+
+        Replayer(const Replayer&) = delete;
+        Replayer& operator=(const Replayer&) = delete;
+
+        bool isOpen() const { return m_file != nullptr; }
+        // Size of the screen at the current position
+        int getRows() const { return m_rows; }
+        int getColumns() const { return m_columns; }
+        std::chrono::system_clock::time_point getStarted() const { return m_started; }
+        std::size_t getKeyframes() const { return m_count; }
+
+        // Time of the next record since the start of the recording, false at the end
+        bool next(std::chrono::microseconds& time) const {
+            if (!m_hasNext) {
+                return false;
+            }
+            time = std::chrono::microseconds((long long)recordTime(m_next));
+            return true;
+        }
+
+        /*
+            Redraws the screen as it was at time: writes the last keyframe before it (or starts over
+            when there is none) and the output since then at once. Play continues from there.
+        */
+        bool seek(std::ostream& out, std::chrono::microseconds time) {
+            if (!m_file) {
+                return false;
+            }
+            std::uint64_t target = time.count() > 0 ? (std::uint64_t)time.count() : 0;
+            std::size_t low = 0;
+            std::size_t high = m_count;
+            while (low < high) {
+                std::size_t middle = low + (high - low) / 2;
+                if (entryTime(middle) <= target) {
+                    low = middle + 1;
+                } else {
+                    high = middle;
+                }
+            }
+            // An entry that points outside the recording is not used
+            std::uint64_t offset = low > 0 ? detail::decodeFixed(m_entries + (low - 1) * detail::IndexEntrySize + 8) : m_first;
+            if (offset < m_first || offset >= m_fileSize) {
+                offset = m_first;
+            }
+            if (!detail::seekFile(m_file, offset)) {
+                return false;
+            }
+            m_time = 0;
+            m_hasNext = readRecord(m_next);
+            if (offset == m_first) {
+                resize(out, m_startRows, m_startColumns);
+            }
+            if (m_hasNext && m_next.type == detail::RecordType::Keyframe) {
+                take(out, true);
+            }
+            while (m_hasNext && recordTime(m_next) <= target) {
+                take(out, false);
+            }
+            out.flush();
+            return true;
+        }
+
+        /*
+            Writes the records as they were timed until the end or until the given time. Speed 2 plays
+            twice as fast, 0 writes everything at once. Keyframes are not written, the output before
+            them has drawn the same screen already.
+        */
+        bool play(std::ostream& out, double speed = 1.0,
+            std::chrono::microseconds until = std::chrono::microseconds::max())
+        {
+            if (!m_file) {
+                return false;
+            }
+            auto start = std::chrono::steady_clock::now();
+            std::uint64_t first = m_hasNext ? recordTime(m_next) : 0;
+            while (m_hasNext && recordTime(m_next) <= (std::uint64_t)until.count()) {
+                if (speed > 0) {
+                    auto due = std::chrono::microseconds((long long)((double)(recordTime(m_next) - first) / speed));
+                    std::this_thread::sleep_until(start + due);
+                }
+                take(out, false);
+                if (speed > 0) {
+                    out.flush();
+                }
+            }
+            out.flush();
+            return !std::ferror(m_file);
+        }
+
+    private:
+        bool readHeader() {
+            unsigned char header[5];
+            if (std::fread(header, 1, sizeof(header), m_file) != sizeof(header) ||
+                std::memcmp(header, detail::RecordingMagic, 4) != 0 || header[4] != detail::RecordingVersion) {
+                return false;
+            }
+            unsigned char started[8];
+            if (!readSize(m_file, m_startRows, m_startColumns) ||
+                std::fread(started, 1, sizeof(started), m_file) != sizeof(started)) {
+                return false;
+            }
+            m_rows = m_startRows;
+            m_columns = m_startColumns;
+            m_started = std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                std::chrono::microseconds((long long)detail::decodeFixed(started))));
+            m_first = detail::tellFile(m_file);
+            if (std::fseek(m_file, 0, SEEK_END) != 0) {
+                return false;
+            }
+            m_fileSize = detail::tellFile(m_file);
+            return detail::seekFile(m_file, m_first);
+        }
+
+        void openIndex(const char* path) {
+#if !defined(_WIN32)
+            int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                return;
+            }
+            struct stat info;
+            if (::fstat(fd, &info) == 0 && info.st_size >= (off_t)detail::IndexEntrySize) {
+                void* mapped = ::mmap(nullptr, (std::size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (mapped != MAP_FAILED) {
+                    m_entries = (const unsigned char*)mapped;
+                    m_mappedSize = (std::size_t)info.st_size;
+                    m_count = m_mappedSize / detail::IndexEntrySize;
+                }
+            }
+            ::close(fd);
+#else
+            std::FILE* file = std::fopen(path, "rb");
+            if (!file) {
+                return;
+            }
+            unsigned char data[4096];
+            std::size_t size;
+            while ((size = std::fread(data, 1, sizeof(data), file)) > 0) {
+                m_loaded.insert(m_loaded.end(), data, data + size);
+            }
+            std::fclose(file);
+            m_entries = m_loaded.data();
+            m_count = m_loaded.size() / detail::IndexEntrySize;
+#endif
+        }
+
+        std::uint64_t entryTime(std::size_t index) const {
+            return detail::decodeFixed(m_entries + index * detail::IndexEntrySize);
+        }
+
+        std::uint64_t recordTime(const Record& record) const {
+            return record.type == detail::RecordType::Keyframe ? record.time : m_time + record.time;
+        }
+
+        // Follows the size of the recording, only a VirtualTerminal can be resized
+        void resize(std::ostream& out, int rows, int columns) {
+            m_rows = rows;
+            m_columns = columns;
+            if (VirtualTerminal* screen = dynamic_cast<VirtualTerminal*>(&out)) {
+                if (screen->getRows() != rows || screen->getColumns() != columns) {
+                    screen->resize(rows, columns);
+                }
+            }
+        }
+
+        // Writes the next record and reads the one after it, keyframes only when asked for
+        void take(std::ostream& out, bool keyframe) {
+            m_time = recordTime(m_next);
+            switch (m_next.type) {
+            case detail::RecordType::Chunk:
+                out.write(m_next.data.data(), (std::streamsize)m_next.data.size());
+                break;
+            case detail::RecordType::Keyframe:
+                if (keyframe) {
+                    resize(out, m_next.rows, m_next.columns);
+                    out.write(m_next.data.data() + m_next.payload, (std::streamsize)(m_next.data.size() - m_next.payload));
+                }
+                break;
+            case detail::RecordType::Resize:
+                out.flush();
+                resize(out, m_next.rows, m_next.columns);
+                break;
+            }
+            m_hasNext = readRecord(m_next);
+        }
+
+        // False at the end and for anything that is not a whole record inside the file
+        bool readRecord(Record& record) {
+            int type = std::fgetc(m_file);
+            std::uint64_t size = 0;
+            if (type < (int)detail::RecordType::Chunk || type > (int)detail::RecordType::Resize ||
+                !detail::readVarint(m_file, record.time) || !detail::readVarint(m_file, size)) {
+                return false;
+            }
+            std::uint64_t position = detail::tellFile(m_file);
+            if (position > m_fileSize || size > m_fileSize - position) {
+                return false;
+            }
+            record.type = (detail::RecordType)type;
+            record.data.resize((std::size_t)size);
+            if (size > 0 && std::fread(&record.data[0], 1, (std::size_t)size, m_file) != (std::size_t)size) {
+                return false;
+            }
+            record.payload = 0;
+            if (record.type != detail::RecordType::Chunk) {
+                const unsigned char* data = (const unsigned char*)record.data.data();
+                std::size_t used = 0;
+                if (!decodeSize(data, record.data.size(), used, record.rows, record.columns)) {
+                    return false;
+                }
+                record.payload = used;
+            }
+            return true;
+        }
+
+        static bool validSize(std::uint64_t rows, std::uint64_t columns) {
+            return rows > 0 && columns > 0 && rows <= detail::MaxRecordedSize && columns <= detail::MaxRecordedSize;
+        }
+
+        static bool readSize(std::FILE* file, int& rows, int& columns) {
+            std::uint64_t r = 0;
+            std::uint64_t c = 0;
+            if (!detail::readVarint(file, r) || !detail::readVarint(file, c) || !validSize(r, c)) {
+                return false;
+            }
+            rows = (int)r;
+            columns = (int)c;
+            return true;
+        }
+
+        static bool decodeSize(const unsigned char* data, std::size_t size, std::size_t& used, int& rows, int& columns) {
+            std::uint64_t values[2] = { 0, 0 };
+            used = 0;
+            for (std::uint64_t& value : values) {
+                for (int shift = 0;; shift += 7) {
+                    if (used == size || shift >= 64) {
+                        return false;
+                    }
+                    unsigned char c = data[used++];
+                    value |= (std::uint64_t)(c & 0x7F) << shift;
+                    if ((c & 0x80) == 0) {
+                        break;
+                    }
+                }
+            }
+            if (!validSize(values[0], values[1])) {
+                return false;
+            }
+            rows = (int)values[0];
+            columns = (int)values[1];
+            return true;
+        }
+    };
+}
@@ -0,0 +1,256 @@
+#pragma once
+
+#include "Terminal.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+/**
+    Double buffered cell grid
+
+    Drawing goes to the back grid, present() writes the difference between the
+    back grid and what is on the terminal (front grid) using the cheapest cursor
+    movement for every changed cell, then makes the back grid the new front.
+
+    Rows and columns are zero based, sequences are written one based.
+*/
+namespace terminal
+{
+    struct Cell
+    {
+        // Right half of a wide character, the character itself is in the cell before
+        static constexpr char32_t WideTail = 0;
+
+        char32_t codepoint = U' ';
+        Pen pen;
+
+        Cell() {}
+        Cell(char32_t codepoint, const Pen& pen) : codepoint(codepoint), pen(pen) {}
+
+        bool operator==(const Cell& other) const { return codepoint == other.codepoint && pen == other.pen; }
+        bool operator!=(const Cell& other) const { return !(*this == other); }
+    };
+
+    class Screen {
+    private:
+        int m_rows;
+        int m_columns;
+        std::vector<Cell> m_front;
+        std::vector<Cell> m_back;
+        // Changed columns [first, last) of every row of the back grid since the last present
+        std::vector<std::pair<int, int>> m_damage;
+        bool m_repaint = true;
+        std::string m_frame;
+        ColorLevel m_colors = ColorLevel::TrueColor;
+    public:
+        Screen(int rows, int columns) { resize(rows, columns); }
+
+        int getRows() const { return m_rows; }
+        int getColumns() const { return m_columns; }
+
+        // Resizing clears the back grid and repaints the whole screen on the next present
+        void resize(int rows, int columns) {
+            m_rows = rows > 0 ? rows : 0;
+            m_columns = columns > 0 ? columns : 0;
+            m_front.assign((std::size_t)m_rows * m_columns, Cell());
+            m_back.assign((std::size_t)m_rows * m_columns, Cell());
+            m_damage.assign((std::size_t)m_rows, std::make_pair(m_columns, 0));
+            m_repaint = true;
+        }
+
+        // Front grid is assumed to be lost (e.g. something else has written to the terminal)
+        void invalidate() { m_repaint = true; }
+
+        const Cell& at(int row, int column) const { return m_back[(std::size_t)row * m_columns + column]; }
+
+        // A wide character takes this cell and the next (Cell::WideTail), it is not put when the
+        // next cell is off the screen. Half of a wide character that is overwritten becomes a blank.
+        void put(int row, int column, char32_t codepoint, const Pen& pen = Pen()) {
+            if (row < 0 || row >= m_rows || column < 0 || column >= m_columns) {
+                return;
+            }
+            bool wide = codepoint != Cell::WideTail && detail::codepointWidth(codepoint) == 2;
+            if (wide && column + 1 >= m_columns) {
+                return;
+            }
+            Cell* cells = &m_back[(std::size_t)row * m_columns];
+            int last = wide ? column + 1 : column;
+            if (column > 0 && cells[column].codepoint == Cell::WideTail) {
+                set(row, column - 1, Cell(U' ', cells[column - 1].pen));
+            }
+            if (last + 1 < m_columns && cells[last + 1].codepoint == Cell::WideTail) {
+                set(row, last + 1, Cell(U' ', cells[last + 1].pen));
+            }
+            set(row, column, Cell(codepoint, pen));
+            if (wide) {
+                set(row, column + 1, Cell(Cell::WideTail, pen));
+            }
+        }
+
+        // Writes UTF-8 text starting at the given cell, returns the column after the text.
+        // Wide characters take two cells, combining marks none.
+        int print(int row, int column, std::string_view text, const Pen& pen = Pen()) {
+            const char* p = text.data();
+            const char* end = p + text.size();
+            while (p < end && column < m_columns) {
+                char32_t codepoint = detail::decodeUtf8(p, end);
+                int width = detail::codepointWidth(codepoint);
+                if (width == 0) {
+                    continue;
+                }
+                if (column + width > m_columns) {
+                    break;
+                }
+                put(row, column, codepoint, pen);
+                column += width;
+            }
+            return column;
+        }
+
+        void fill(int row, int column, int rows, int columns, char32_t codepoint = U' ', const Pen& pen = Pen()) {
+            for (int r = row; r < row + rows; r++) {
+                for (int c = column; c < column + columns; c++) {
+                    put(r, c, codepoint, pen);
+                }
+            }
+        }
+
+        void clear(const Pen& pen = Pen()) { fill(0, 0, m_rows, m_columns, U' ', pen); }
+
+        // Writes the changes since the last present as one block, returns the number of bytes written.
+        // Colors are downsampled to the ColorLevel of the stream (see Console::setColorLevel).
+        std::size_t present(std::ostream& out) {
+            m_frame.clear();
+            m_colors = detail::streamColorLevel(out);
+            Pen pen;
+            int cursorRow = -1;
+            int cursorColumn = -1;
+
+            if (m_repaint) {
+                m_frame += m_colors == ColorLevel::None ? "\x1b[2J" : "\x1b[0m\x1b[2J";
+                std::fill(m_front.begin(), m_front.end(), Cell());
+                for (auto& damage : m_damage) {
+                    damage = std::make_pair(0, m_columns);
+                }
+                m_repaint = false;
+            }
+
+            for (int row = 0; row < m_rows; row++) {
+                auto& damage = m_damage[(std::size_t)row];
+                Cell* back = &m_back[(std::size_t)row * m_columns];
+                Cell* front = &m_front[(std::size_t)row * m_columns];
+
+                for (int column = damage.first; column < damage.second; column++) {
+                    if (back[column] == front[column]) {
+                        continue;
+                    }
+                    if (back[column].codepoint == Cell::WideTail) {
+                        // Drawn with the character before it
+                        front[column] = back[column];
+                        continue;
+                    }
+                    if (cursorRow != row || cursorColumn != column) {
+                        moveCursor(pen, back, row, column, cursorRow, cursorColumn);
+                    }
+                    writeCell(pen, back[column]);
+                    front[column] = back[column];
+                    int width = 1;
+                    if (column + 1 < m_columns && back[column + 1].codepoint == Cell::WideTail) {
+                        front[column + 1] = back[column + 1];
+                        width = 2;
+                    }
+                    cursorRow = row;
+                    // Cursor stays on the last column with a pending wrap, its position is not reliable
+                    cursorColumn = column + width < m_columns ? column + width : -1;
+                    column += width - 1;
+                }
+                damage = std::make_pair(m_columns, 0);
+            }
+
+            if (!pen.isDefault()) {
+                appendPen(pen, Pen());
+            }
+            out.write(m_frame.data(), (std::streamsize)m_frame.size());
+            return m_frame.size();
+        }
+
+    private:
+        void set(int row, int column, const Cell& cell) {
+            Cell& target = m_back[(std::size_t)row * m_columns + column];
+            if (target != cell) {
+                target = cell;
+                auto& damage = m_damage[(std::size_t)row];
+                if (column < damage.first) damage.first = column;
+                if (column + 1 > damage.second) damage.second = column + 1;
+            }
+        }
+
+        static std::size_t digits(int value) {
+            std::size_t count = 1;
+            while (value >= 10) {
+                value /= 10;
+                count++;
+            }
+            return count;
+        }
+
+        void appendPen(Pen& pen, const Pen& next) {
+            char sequence[detail::MaxPenSequence];
+            m_frame.append(sequence, detail::encodePen(sequence, pen, next));
+            pen = next;
+        }
+
+        void writeCell(Pen& pen, const Cell& cell) {
+            Pen next = m_colors == ColorLevel::TrueColor ? cell.pen : detail::downsample(cell.pen, m_colors);
+            if (next != pen) {
+                appendPen(pen, next);
+            }
+            char utf8[4];
+            m_frame.append(utf8, detail::encodeUtf8(cell.codepoint, utf8));
+        }
+
+        // Picks the shortest of: rewriting the cells in between, Cursor::forward or Cursor::home
+        void moveCursor(Pen& pen, const Cell* back, int row, int column, int cursorRow, int cursorColumn) {
+            std::size_t homeCost = 3 + (row > 0 || column > 0 ? digits(row + 1) : 0) + (column > 0 ? 1 + digits(column + 1) : 0);
+
+            if (cursorRow == row && cursorColumn >= 0 && cursorColumn < column) {
+                int gap = column - cursorColumn;
+                std::size_t forwardCost = 3 + (gap > 1 ? digits(gap) : 0);
+
+                bool rewrite = gap < (int)forwardCost && gap < (int)homeCost;
+                for (int c = cursorColumn; rewrite && c < column; c++) {
+                    rewrite = back[c].codepoint >= 0x20 && back[c].codepoint < 0x80 && detail::downsample(back[c].pen, m_colors) == pen;
+                }
+                if (rewrite) {
+                    for (int c = cursorColumn; c < column; c++) {
+                        m_frame += (char)back[c].codepoint;
+                    }
+                    return;
+                }
+                if (forwardCost <= homeCost) {
+                    m_frame += "\x1b[";
+                    if (gap > 1) {
+                        appendNumber(gap);
+                    }
+                    m_frame += 'C';
+                    return;
+                }
+            }
+
+            m_frame += "\x1b[";
+            if (row > 0 || column > 0) {
+                appendNumber(row + 1);
+            }
+            if (column > 0) {
+                m_frame += ';';
+                appendNumber(column + 1);
+            }
+            m_frame += 'H';
+        }
+
+        void appendNumber(int value) {
+            char number[11];
+            m_frame.append(number, (std::size_t)(detail::appendNumber(number, value) - number));
+        }
+    };
+}
@@ -0,0 +1,164 @@
+/*
+	Stress test of per-thread consoles
+		g++ -std=c++17 -O2 Stress.cpp -o Stress -pthread
+		Stress [--quick]
+
+	32 threads write numbered lines through Console::local() while another thread writes to the
+	parent and flushes it. Every line has to arrive once, whole, and in the order of its thread.
+	Runs synchronous, asynchronous with a small ring (so producers wait for the writer thread) and
+	asynchronous with the Grow policy. A run that does not finish in time counts as a failure.
+	Exits with 1 when a run failed.
+*/
+#include "Terminal.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace terminal;
+
+static const int Threads = 32;
+static const std::chrono::seconds Timeout(60);
+
+enum class Mode {
+	Synchronous,
+	Async,
+	AsyncGrow
+};
+
+// Line i of a thread, its length varies so lines cross the buffer and ring boundaries
+static void appendPayload(std::string& line, int thread, int index)
+{
+	int length = (thread * 7 + index * 13) % 90;
+	for (int i = 0; i < length; i++) {
+		line += (char)('a' + (thread + index + i) % 26);
+	}
+}
+
+static bool check(const std::string& output, int lines, long long parentLines)
+{
+	std::vector<int> next(Threads, 0);
+	long long parents = 0;
+	std::string expected;
+	std::size_t position = 0;
+	while (position < output.size()) {
+		std::size_t end = output.find('\n', position);
+		if (end == std::string::npos) {
+			std::printf("  unterminated line at %zu\n", position);
+			return false;
+		}
+		std::string line = output.substr(position, end - position);
+		position = end + 1;
+
+		if (line == "parent") {
+			parents++;
+			continue;
+		}
+		int thread = -1;
+		int index = -1;
+		int consumed = 0;
+		if (std::sscanf(line.c_str(), "T%d L%d %n", &thread, &index, &consumed) != 2 ||
+			thread < 0 || thread >= Threads) {
+			std::printf("  broken line: %.80s\n", line.c_str());
+			return false;
+		}
+		if (index != next[thread]) {
+			std::printf("  thread %d: line %d where %d was expected\n", thread, index, next[thread]);
+			return false;
+		}
+		expected.clear();
+		appendPayload(expected, thread, index);
+		if (line.compare((std::size_t)consumed, std::string::npos, expected) != 0) {
+			std::printf("  thread %d line %d: payload is damaged\n", thread, index);
+			return false;
+		}
+		next[thread]++;
+	}
+	for (int thread = 0; thread < Threads; thread++) {
+		if (next[thread] != lines) {
+			std::printf("  thread %d: %d of %d lines\n", thread, next[thread], lines);
+			return false;
+		}
+	}
+	if (parents != parentLines) {
+		std::printf("  %lld of %lld parent lines\n", parents, parentLines);
+		return false;
+	}
+	return true;
+}
+
+static bool run(const char* name, Mode mode, int lines)
+{
+	MemorySink sink;
+	std::atomic<bool> finished(false);
+	long long parentLines = 0;
+	auto start = std::chrono::steady_clock::now();
+
+	// A hang in the Console must not hang the test
+	std::thread watchdog([&] {
+		while (!finished.load()) {
+			if (std::chrono::steady_clock::now() - start > Timeout) {
+				std::printf("%-36s FAILED (no progress after %d s)\n", name, (int)Timeout.count());
+				std::fflush(stdout);
+				std::_Exit(1);
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		}
+	});
+
+	{
+		Console con(sink);
+		if (mode == Mode::Async) {
+			con.startAsync(4096);
+		} else if (mode == Mode::AsyncGrow) {
+			con.startAsync(4096, AsyncPolicy::Grow);
+		}
+
+		std::atomic<int> running(Threads);
+		std::vector<std::thread> threads;
+		for (int thread = 0; thread < Threads; thread++) {
+			threads.emplace_back([&con, &running, thread, lines] {
+				Console& local = con.local();
+				std::string payload;
+				for (int index = 0; index < lines; index++) {
+					payload.clear();
+					appendPayload(payload, thread, index);
+					local << "T" << thread << " L" << index << " " << payload << "\n";
+				}
+				running--;
+			});
+		}
+		std::thread parent([&con, &running, &parentLines] {
+			while (running.load() > 0) {
+				con << "parent\n";
+				con.flush();
+				parentLines++;
+			}
+		});
+
+		for (std::thread& thread : threads) {
+			thread.join();
+		}
+		parent.join();
+	}
+	finished.store(true);
+	watchdog.join();
+
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	bool passed = check(sink.getData(), lines, parentLines);
+	std::printf("%-36s %s (%.2f s, %zu bytes)\n", name, passed ? "passed" : "FAILED", elapsed, sink.size());
+	return passed;
+}
+
+int main(int argc, char** argv)
+{
+	bool quick = argc > 1 && std::strcmp(argv[1], "--quick") == 0;
+	const int lines = quick ? 2000 : 20000;
+
+	bool passed = run("local(), synchronous", Mode::Synchronous, lines);
+	passed = run("local(), async ring of 4 KB", Mode::Async, lines) && passed;
+	passed = run("local(), async Grow", Mode::AsyncGrow, lines) && passed;
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,223 @@
+#pragma once
+
+#include "Terminal.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <exception>
+#include <initializer_list>
+
+/**
+    Table of UTF-8 cells laid out in columns
+
+    Every column has a Style for its colors, attributes and alignment, its width is the
+    widest cell (in display cells) or the Style width when that is larger:
+        Table table;
+        table.column(Style().bold()).column(Style().right().green());
+        table.row({ "name", "value" });
+        table.render(con);
+
+    Rows are formatted into one line and written with a single write, cells next to each other
+    with the same style share one SGR run and the pen is reset before the end of every line.
+    A table without a stream only writes in render(): rows it still holds when it is destroyed
+    are lost, which debug builds assert on.
+
+    Streaming tables fix the widths after the first sampleRows rows and write every following
+    row as it is added, so only the sample is ever held. Cells wider than the fixed width are
+    written whole and push the rest of their row to the right.
+        Table table(con, 100);
+        for (...) table.row({ ... });
+        table.finish();
+*/
+namespace terminal
+{
+    class Table {
+    private:
+        struct Column {
+            Style style;
+            std::size_t width = 0;
+        };
+
+        // Cell of a held row, its text is in m_text
+        struct Entry {
+            std::size_t offset;
+            std::size_t size;
+            std::size_t width;
+        };
+
+        std::vector<Column> m_columns;
+        std::string m_separator = " ";
+
+        std::string m_text;
+        std::vector<Entry> m_entries;
+        std::vector<std::size_t> m_rows;
+
+        std::ostream* m_out = nullptr;
+        std::size_t m_sampleRows = 0;
+        bool m_fixed = false;
+
+        // Sequences between the cells: pen changes and separators, compiled once per render
+        std::vector<std::string> m_joins;
+
+        // Reused for every row
+        std::vector<std::string_view> m_views;
+        std::vector<std::size_t> m_widths;
+        std::string m_line;
+    public:
+        Table() {}
+
+        // Streaming table: widths are fixed by the first sampleRows rows
+        Table(std::ostream& out, std::size_t sampleRows) :
+            m_out(&out), m_sampleRows(sampleRows > 0 ? sampleRows : 1)
+        { }
+
+        ~Table() {
+            finish();
+            assert((m_rows.empty() || std::uncaught_exceptions() > 0) && "rows of a Table were never rendered");
+        }
+
+        Table(const Table&) = delete;
+        Table& operator=(const Table&) = delete;
+
+        // Adds a column, the text of the style is not used
+        Table& column(const Style& style = Style()) {
+            Column column;
+            column.style = style;
+            column.width = style.getWidth() > 0 ? (std::size_t)style.getWidth() : 0;
+            m_columns.push_back(column);
+            return *this;
+        }
+
+        // Written between cells (a single space by default)
+        Table& separator(std::string_view separator) {
+            m_separator.assign(separator.data(), separator.size());
+            return *this;
+        }
+
+        std::size_t getColumnCount() const { return m_columns.size(); }
+        std::size_t getColumnWidth(std::size_t column) const { return m_columns[column].width; }
+
+        void row(std::initializer_list<std::string_view> cells) { row(cells.begin(), cells.size()); }
+
+        // Missing cells are empty, cells past the last column add columns with the default style
+        void row(const std::string_view* cells, std::size_t count) {
+            while (m_columns.size() < count) {
+                column();
+            }
+            if (m_fixed) {
+                m_views.assign(cells, cells + count);
+                m_widths.resize(count);
+                for (std::size_t i = 0; i < count; i++) {
+                    m_widths[i] = displayWidth(cells[i]);
+                }
+                writeRow(*m_out, m_views.data(), m_widths.data(), count);
+                return;
+            }
+
+            m_rows.push_back(m_entries.size());
+            for (std::size_t i = 0; i < count; i++) {
+                Entry entry = { m_text.size(), cells[i].size(), displayWidth(cells[i]) };
+                m_text.append(cells[i].data(), cells[i].size());
+                m_entries.push_back(entry);
+                m_columns[i].width = std::max(m_columns[i].width, entry.width);
+            }
+            if (m_out && m_rows.size() == m_sampleRows) {
+                fix();
+            }
+        }
+
+        // Writes and forgets the rows added so far
+        void render(std::ostream& out) {
+            compileJoins(out);
+            for (std::size_t row = 0; row < m_rows.size(); row++) {
+                std::size_t first = m_rows[row];
+                std::size_t last = row + 1 < m_rows.size() ? m_rows[row + 1] : m_entries.size();
+                m_views.clear();
+                m_widths.clear();
+                for (std::size_t i = first; i < last; i++) {
+                    m_views.emplace_back(m_text.data() + m_entries[i].offset, m_entries[i].size);
+                    m_widths.push_back(m_entries[i].width);
+                }
+                writeRow(out, m_views.data(), m_widths.data(), last - first);
+            }
+            m_text.clear();
+            m_entries.clear();
+            m_rows.clear();
+        }
+
+        // Streaming table with fewer rows than the sample: writes them with the widths found so far
+        void finish() {
+            if (m_out && !m_fixed) {
+                fix();
+            }
+        }
+
+    private:
+        void fix() {
+            m_fixed = true;
+            render(*m_out);
+        }
+
+        /*
+            Joins are what comes before every cell and after the last one. The separator belongs
+            to a run only when both neighbours share the pen, otherwise it is written with the
+            default pen. The last join resets the pen and ends the line.
+        */
+        void compileJoins(std::ostream& out) {
+            ColorLevel level = detail::streamColorLevel(out);
+            std::size_t count = m_columns.size();
+            m_joins.assign(count + 1, std::string());
+            Pen current;
+            for (std::size_t i = 0; i <= count; i++) {
+                Pen pen = i < count ? detail::compilePen(m_columns[i].style.pen(), level).output : Pen();
+                std::string& join = m_joins[i];
+                if (i > 0 && i < count) {
+                    if (pen != current) {
+                        appendPen(join, current, Pen());
+                    }
+                    join += m_separator;
+                }
+                appendPen(join, current, pen);
+                if (i == count) {
+                    join += '\n';
+                }
+            }
+        }
+
+        static void appendPen(std::string& join, Pen& current, const Pen& next) {
+            char sequence[detail::MaxPenSequence];
+            join.append(sequence, detail::encodePen(sequence, current, next));
+            current = next;
+        }
+
+        void writeRow(std::ostream& out, const std::string_view* cells, const std::size_t* widths, std::size_t count) {
+            if (m_joins.size() != m_columns.size() + 1) {
+                compileJoins(out);
+            }
+            m_line.clear();
+            for (std::size_t i = 0; i < m_columns.size(); i++) {
+                m_line += m_joins[i];
+
+                std::string_view text = i < count ? cells[i] : std::string_view();
+                std::size_t width = i < count ? widths[i] : 0;
+                std::size_t padding = m_columns[i].width > width ? m_columns[i].width - width : 0;
+                std::size_t before = 0;
+                switch (m_columns[i].style.getAlignment()) {
+                case Aligment::Left:
+                    break;
+                case Aligment::Right:
+                    before = padding;
+                    break;
+                case Aligment::Center:
+                    before = padding / 2;
+                    break;
+                }
+                m_line.append(before, ' ');
+                m_line.append(text.data(), text.size());
+                m_line.append(padding - before, ' ');
+            }
+            m_line += m_joins.back();
+            out.write(m_line.data(), (std::streamsize)m_line.size());
+        }
+    };
+}
@@ -1,8 +1,43 @@
-﻿#include <iostream>
+﻿#pragma once
+
+#include <iostream>
 #include <string>
 #include <string_view>
 #include <streambuf>
 #include <iomanip>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <cstdint>
+#include <charconv>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+
+#include "UnicodeWidth.hpp"
+
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+#endif
+
+#include <fcntl.h>
+
+#if defined(_WIN32)
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#endif
 
 /**
     @Author: Edin Omeragic
@@ -10,8 +45,19 @@
     @Version: v0.1 - Support for text and background basic colors and true colors
     @Version: v0.1 - Support for errasing text, cursor movement, scrolling
     @Version: v0.1 - Nesting output using enterLevel, exitLevel and resetLevel
-
-    @ToDo: Reading response from terminal (DeviceStatus enum)
+    @Version: v0.2 - Console owns a put area buffer and flushes it with a single write per buffer
+    @Version: v0.2 - Console tracks the pen state and writes only the SGR differences between styles
+    @Version: v0.2 - Asynchronous Console mode with a lock-free ring drained by a writer thread
+    @Version: v0.2 - Per-thread consoles (Console::local) committing whole lines atomically
+    @Version: v0.2 - Color support detection (NO_COLOR, TERM, COLORTERM) and downsampling to 256 and 16 colors
+    @Version: v0.2 - Escape sequences are stripped when not writing to a terminal (EscapeFilter, stripEscapes)
+    @Version: v0.2 - Incremental input parser (InputParser) and Console::query for device responses
+    @Version: v0.2 - Style width and alignment count display cells (UnicodeWidth.hpp), center alignment fixed
+    @Version: v0.2 - Frames (Console::beginFrame, endFrame) written at once in synchronized update mode
+    @Version: v0.2 - Output sinks (FdSink, MemorySink, FileSink), large payloads written by reference with writev
+    @Version: v0.2 - Non-blocking mode (setNonBlocking, tryFlush, pollOut) keeping unsent output in order
+    @Version: v0.2 - Overload policy for the message helpers: repeats coalesced, rate limits, shedding by severity
+    @Version: v0.2 - Output counters (Console::stats, resetStats) when compiled with TERMINAL_STATS
 
     @BasedOn: http://www.termsys.demon.co.uk/vtansi.htm
 */
@@ -19,6 +65,7 @@ namespace terminal
 {
     class Scroll;
     class Cursor;
+    class Device;
     enum class TextColor;
     enum class Attribute;
     enum class BackgroundColor;
@@ -26,19 +73,22 @@ namespace terminal
     enum class TabControl;
     enum class Terminal;
 
-    std::ostream& operator<<(std::ostream& out, const Scroll& scroll);
-    std::ostream& operator<<(std::ostream& out, const Cursor& cursor);
-    std::ostream& operator<<(std::ostream& out, TextColor color);
-    std::ostream& operator<<(std::ostream& out, Attribute sequence);
-    std::ostream& operator<<(std::ostream& out, BackgroundColor color);
-    std::ostream& operator<<(std::ostream& out, EraseText value);
-    std::ostream& operator<<(std::ostream& out, TabControl value);
-    std::ostream& operator<<(std::ostream& out, Terminal terminal);
+    inline std::ostream& operator<<(std::ostream& out, const Scroll& scroll);
+    inline std::ostream& operator<<(std::ostream& out, const Cursor& cursor);
+    inline std::ostream& operator<<(std::ostream& out, TextColor color);
+    inline std::ostream& operator<<(std::ostream& out, Attribute sequence);
+    inline std::ostream& operator<<(std::ostream& out, BackgroundColor color);
+    inline std::ostream& operator<<(std::ostream& out, EraseText value);
+    inline std::ostream& operator<<(std::ostream& out, TabControl value);
+    inline std::ostream& operator<<(std::ostream& out, Terminal terminal);
+    inline std::ostream& operator<<(std::ostream& out, const Device& device);
 
     enum class Terminal {
         ResetDevice,		   //<ESC>c
         EnableLineWrap,		   //<ESC>[7h
-        DisableLineWrap		   //<ESC>[7l
+        DisableLineWrap,	   //<ESC>[7l
+        BeginSynchronizedUpdate,   //<ESC>[?2026h
+        EndSynchronizedUpdate      //<ESC>[?2026l
     };
 
     /*
@@ -81,10 +131,10 @@ namespace terminal
         static Device reportDeviceFailure() { return Device(DeviceStatus::ReportDeviceFailure); }
         static Device reportCursorPosition(int row, int col) { return Device(DeviceStatus::ReportCursorPosition, row, col); }
 
-        DeviceStatus getStatus() { return status; }
-        int getCount() { return row; }
-        int getRow() { return row; }
-        int getColumn() { return column; }
+        DeviceStatus getStatus() const { return status; }
+        int getCount() const { return row; }
+        int getRow() const { return row; }
+        int getColumn() const { return column; }
     };
 
     enum class TabControl {
@@ -143,7 +193,7 @@ namespace terminal
         Hidden = 8
     };
 
-    enum class Aligment
+    enum class Aligment : std::uint8_t
     {
         Left,
         Center,
@@ -203,136 +253,658 @@ namespace terminal
         int b;
         Color() : r(0), g(0), b(0) {}
         Color(int r, int g, int b) : r(r), g(g), b(b) {}
+
+        bool operator==(const Color& other) const { return r == other.r && g == other.g && b == other.b; }
+        bool operator!=(const Color& other) const { return !(*this == other); }
+    };
+
+    /*
+        Pen
+        Graphic rendition state of the terminal (what the last SGR sequences have set), 9 bytes of state
+        in 12 (two colors and the attributes, padded to the alignment of the colors).
+        Colors hold their kind in the top byte and the basic SGR code, 256 color index or 8 bit RGB below.
+    */
+    struct Pen
+    {
+        enum : std::uint8_t {
+            Bold = 1 << 0,
+            Dim = 1 << 1,
+            Underscore = 1 << 2,
+            Blink = 1 << 3,
+            Reverse = 1 << 4,
+            Hidden = 1 << 5
+        };
+
+        static constexpr std::uint32_t NoColor = 0;
+        static constexpr std::uint32_t BasicColor = 1u << 24;
+        static constexpr std::uint32_t TrueColor = 2u << 24;
+        static constexpr std::uint32_t IndexedColor = 3u << 24;
+
+        std::uint32_t text = NoColor;
+        std::uint32_t background = NoColor;
+        std::uint8_t attributes = 0;
+
+        static std::uint32_t basic(int code) { return code != 0 ? BasicColor | (std::uint32_t)code : NoColor; }
+
+        static std::uint32_t rgb(const Color& color) {
+            auto channel = [](int value) { return (std::uint32_t)(value < 0 ? 0 : value > 255 ? 255 : value); };
+            return TrueColor | (channel(color.r) << 16) | (channel(color.g) << 8) | channel(color.b);
+        }
+
+        static std::uint32_t indexed(int index) { return IndexedColor | (std::uint32_t)(index & 0xFF); }
+
+        static std::uint32_t kind(std::uint32_t color) { return color & 0xFF000000u; }
+        static bool isTrue(std::uint32_t color) { return kind(color) == TrueColor; }
+        static int code(std::uint32_t color) { return (int)(color & 0xFF); }
+        static Color color(std::uint32_t color) { return Color((color >> 16) & 0xFF, (color >> 8) & 0xFF, color & 0xFF); }
+
+        bool isDefault() const { return text == NoColor && background == NoColor && attributes == 0; }
+
+        bool operator==(const Pen& other) const {
+            return text == other.text && background == other.background && attributes == other.attributes;
+        }
+        bool operator!=(const Pen& other) const { return !(*this == other); }
+    };
+
+    static_assert(sizeof(Pen) <= 12, "Pen should stay packed");
+
+    /*
+        Colors a terminal can show
+        None        No SGR sequences at all (not a terminal, NO_COLOR or TERM=dumb)
+        Colors16    8 basic colors and their bright variants
+        Colors256   xterm 256 color palette (TERM=*256color)
+        TrueColor   24 bit colors (COLORTERM=truecolor or 24bit)
+    */
+    enum class ColorLevel {
+        None,
+        Colors16,
+        Colors256,
+        TrueColor
     };
 
+    namespace detail
+    {
+        // Longest SGR sequence produced by encodePen: reset, six attributes and two true colors
+        constexpr std::size_t MaxPenSequence = 64;
+
+        // Run of spaces used for indentation and padding without a per-space loop
+        constexpr std::string_view SpaceRun =
+            "                                                                "
+            "                                                                ";
+
+        inline void writePadding(std::ostream& out, std::size_t count) {
+            while (count > 0) {
+                std::size_t run = count < SpaceRun.size() ? count : SpaceRun.size();
+                out.write(SpaceRun.data(), (std::streamsize)run);
+                count -= run;
+            }
+        }
+
+        inline char* appendNumber(char* out, int value) {
+            return std::to_chars(out, out + 11, value).ptr;
+        }
+
+        // Decodes one UTF-8 sequence and advances the pointer, malformed input yields U+FFFD
+        inline char32_t decodeUtf8(const char*& p, const char* end) {
+            unsigned char lead = (unsigned char)*p++;
+            if (lead < 0x80) {
+                return lead;
+            }
+            int length = lead >= 0xF0 ? 3 : lead >= 0xE0 ? 2 : lead >= 0xC0 ? 1 : -1;
+            if (length < 0 || lead > 0xF4 || end - p < length) {
+                return U'\xFFFD';
+            }
+            char32_t codepoint = lead & (0x3F >> length);
+            for (int i = 0; i < length; i++) {
+                unsigned char next = (unsigned char)p[i];
+                if ((next & 0xC0) != 0x80) {
+                    p += i;
+                    return U'\xFFFD';
+                }
+                codepoint = (codepoint << 6) | (next & 0x3F);
+            }
+            p += length;
+            return codepoint;
+        }
+
+        inline std::size_t encodeUtf8(char32_t codepoint, char* out) {
+            if (codepoint < 0x80) {
+                out[0] = (char)codepoint;
+                return 1;
+            }
+            if (codepoint < 0x800) {
+                out[0] = (char)(0xC0 | (codepoint >> 6));
+                out[1] = (char)(0x80 | (codepoint & 0x3F));
+                return 2;
+            }
+            if (codepoint < 0x10000) {
+                out[0] = (char)(0xE0 | (codepoint >> 12));
+                out[1] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+                out[2] = (char)(0x80 | (codepoint & 0x3F));
+                return 3;
+            }
+            out[0] = (char)(0xF0 | (codepoint >> 18));
+            out[1] = (char)(0x80 | ((codepoint >> 12) & 0x3F));
+            out[2] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+            out[3] = (char)(0x80 | (codepoint & 0x3F));
+            return 4;
+        }
+
+        // Length of the leading run of printable ASCII (0x20 - 0x7E), tested eight bytes at a time
+        inline std::size_t printableAscii(const char* data, std::size_t size) {
+            constexpr std::uint64_t Ones = 0x0101010101010101ull;
+            constexpr std::uint64_t High = 0x8080808080808080ull;
+            std::size_t i = 0;
+            for (; i + 8 <= size; i += 8) {
+                std::uint64_t word;
+                std::memcpy(&word, data + i, 8);
+                // A byte with the high bit set, below 0x20 (borrow) or equal to DEL (zero after xor)
+                std::uint64_t del = word ^ (Ones * 0x7F);
+                if ((word | ((word - Ones * 0x20) & ~word) | ((del - Ones) & ~del)) & High) {
+                    break;
+                }
+            }
+            while (i < size && (unsigned char)data[i] >= 0x20 && (unsigned char)data[i] < 0x7F) {
+                i++;
+            }
+            return i;
+        }
+
+        inline char* appendParameter(char* out, bool& first, int value) {
+            if (!first) {
+                *out++ = ';';
+            }
+            first = false;
+            return appendNumber(out, value);
+        }
+
+        inline char* appendColor(char* out, bool& first, int plane, std::uint32_t color) {
+            switch (Pen::kind(color)) {
+            case Pen::NoColor:
+                return appendParameter(out, first, plane + 1);
+            case Pen::IndexedColor:
+                out = appendParameter(out, first, plane);
+                out = appendParameter(out, first, 5);
+                return appendParameter(out, first, Pen::code(color));
+            case Pen::TrueColor:
+                break;
+            default:
+                return appendParameter(out, first, Pen::code(color));
+            }
+            out = appendParameter(out, first, plane);
+            out = appendParameter(out, first, 2);
+            out = appendParameter(out, first, (int)((color >> 16) & 0xFF));
+            out = appendParameter(out, first, (int)((color >> 8) & 0xFF));
+            return appendParameter(out, first, (int)(color & 0xFF));
+        }
+
+        inline char* appendAttributes(char* out, bool& first, unsigned char attributes) {
+            static const int codes[] = { 1, 2, 4, 5, 7, 8 };
+            for (int i = 0; i < 6; i++) {
+                if (attributes & (1 << i)) {
+                    out = appendParameter(out, first, codes[i]);
+                }
+            }
+            return out;
+        }
+
+        // Parameters that turn pen "from" into pen "to" without a reset
+        inline char* appendPenDelta(char* out, bool& first, const Pen& from, const Pen& to) {
+            unsigned char off = from.attributes & ~to.attributes;
+            unsigned char on = to.attributes & ~from.attributes;
+            if (off & (Pen::Bold | Pen::Dim)) {
+                // 22 clears both bold and dim, the one that stays has to be set again
+                out = appendParameter(out, first, 22);
+                on |= to.attributes & (Pen::Bold | Pen::Dim);
+            }
+            if (off & Pen::Underscore) out = appendParameter(out, first, 24);
+            if (off & Pen::Blink) out = appendParameter(out, first, 25);
+            if (off & Pen::Reverse) out = appendParameter(out, first, 27);
+            if (off & Pen::Hidden) out = appendParameter(out, first, 28);
+
+            // 38 / 48 select a true or indexed color, 39 / 49 the default color of the plane
+            if (to.text != from.text) out = appendColor(out, first, 38, to.text);
+            if (to.background != from.background) out = appendColor(out, first, 48, to.background);
+            return appendAttributes(out, first, on);
+        }
+
+        // Writes the shortest single SGR sequence that changes pen "from" into pen "to"
+        // (either a delta or a reset followed by the new state). Needs MaxPenSequence bytes.
+        inline std::size_t encodePen(char* out, const Pen& from, const Pen& to) {
+            if (from == to) {
+                return 0;
+            }
+            char delta[MaxPenSequence];
+            bool first = true;
+            std::size_t deltaSize = (std::size_t)(appendPenDelta(delta, first, from, to) - delta);
+
+            char reset[MaxPenSequence];
+            std::size_t resetSize = 0;
+            if (!to.isDefault()) {
+                first = false;
+                reset[0] = '0';
+                resetSize = (std::size_t)(appendPenDelta(reset + 1, first, Pen(), to) - reset);
+            }
+
+            bool useReset = resetSize < deltaSize;
+            out[0] = '\x1b';
+            out[1] = '[';
+            std::size_t size = useReset ? resetSize : deltaSize;
+            std::memcpy(out + 2, useReset ? reset : delta, size);
+            out[2 + size] = 'm';
+            return size + 3;
+        }
+
+        /*
+            Nearest palette entries for true colors, looked up by RGB quantized to 5 bits per channel.
+            Both tables are computed once, on first use.
+        */
+        struct ColorTables {
+            std::uint8_t colors16[32768];
+            std::uint8_t colors256[32768];
+
+            static const ColorTables& get() {
+                static const ColorTables tables;
+                return tables;
+            }
+
+            static std::size_t key(std::uint32_t color) {
+                return ((color >> 9) & 0x7C00) | ((color >> 6) & 0x3E0) | ((color >> 3) & 0x1F);
+            }
+
+        private:
+            static int distance(int r1, int g1, int b1, int r2, int g2, int b2) {
+                return (r1 - r2) * (r1 - r2) + (g1 - g2) * (g1 - g2) + (b1 - b2) * (b1 - b2);
+            }
+
+            // Index of the closest of the six xterm cube levels 0, 95, 135, 175, 215, 255
+            static int cubeIndex(int value) { return value < 48 ? 0 : value < 115 ? 1 : (value - 35) / 40; }
+            static int cubeLevel(int index) { return index == 0 ? 0 : 55 + index * 40; }
+
+            ColorTables() {
+                static const int basic[16][3] = {
+                    { 0, 0, 0 }, { 205, 0, 0 }, { 0, 205, 0 }, { 205, 205, 0 },
+                    { 0, 0, 238 }, { 205, 0, 205 }, { 0, 205, 205 }, { 229, 229, 229 },
+                    { 127, 127, 127 }, { 255, 0, 0 }, { 0, 255, 0 }, { 255, 255, 0 },
+                    { 92, 92, 255 }, { 255, 0, 255 }, { 0, 255, 255 }, { 255, 255, 255 }
+                };
+                for (int i = 0; i < 32768; i++) {
+                    int r = ((i >> 10) & 0x1F) << 3 | 4;
+                    int g = ((i >> 5) & 0x1F) << 3 | 4;
+                    int b = (i & 0x1F) << 3 | 4;
+
+                    int best = 0;
+                    for (int c = 1; c < 16; c++) {
+                        if (distance(r, g, b, basic[c][0], basic[c][1], basic[c][2]) <
+                            distance(r, g, b, basic[best][0], basic[best][1], basic[best][2])) {
+                            best = c;
+                        }
+                    }
+                    colors16[i] = (std::uint8_t)best;
+
+                    int cr = cubeIndex(r), cg = cubeIndex(g), cb = cubeIndex(b);
+                    int gray = (r + g + b) / 3;
+                    int grayIndex = gray < 8 ? 0 : gray > 238 ? 23 : (gray - 3) / 10;
+                    int grayLevel = 8 + grayIndex * 10;
+                    bool useGray = distance(r, g, b, grayLevel, grayLevel, grayLevel) <
+                        distance(r, g, b, cubeLevel(cr), cubeLevel(cg), cubeLevel(cb));
+                    colors256[i] = (std::uint8_t)(useGray ? 232 + grayIndex : 16 + 36 * cr + 6 * cg + cb);
+                }
+            }
+        };
+
+        // Maps a color to what the terminal can show, plane is 30 for text and 40 for background
+        inline std::uint32_t downsampleColor(std::uint32_t color, int plane, ColorLevel level) {
+            if (level == ColorLevel::None) {
+                return Pen::NoColor;
+            }
+            if (level == ColorLevel::TrueColor || !Pen::isTrue(color)) {
+                return color;
+            }
+            std::size_t key = ColorTables::key(color);
+            if (level == ColorLevel::Colors256) {
+                return Pen::indexed(ColorTables::get().colors256[key]);
+            }
+            int index = ColorTables::get().colors16[key];
+            return Pen::basic(index < 8 ? plane + index : plane + 60 + index - 8);
+        }
+
+        // Stream word holding the ColorLevel of a stream plus one, zero (any other stream) means true color
+        inline int colorLevelIndex() {
+            static const int index = std::ios_base::xalloc();
+            return index;
+        }
+
+        inline ColorLevel streamColorLevel(std::ios_base& stream) {
+            long value = stream.iword(colorLevelIndex());
+            return value > 0 ? (ColorLevel)(value - 1) : ColorLevel::TrueColor;
+        }
+
+        inline Pen downsample(const Pen& pen, ColorLevel level) {
+            if (level == ColorLevel::TrueColor) {
+                return pen;
+            }
+            Pen result;
+            if (level != ColorLevel::None) {
+                result.text = downsampleColor(pen.text, 30, level);
+                result.background = downsampleColor(pen.background, 40, level);
+                result.attributes = pen.attributes;
+            }
+            return result;
+        }
+
+        /*
+            Recently used pens with their downsampled form and SGR prefix (from the default pen),
+            direct mapped by pen and color level and private to each thread.
+        */
+        struct CompiledPen {
+            Pen pen;
+            ColorLevel level = ColorLevel::TrueColor;
+            bool valid = false;
+            Pen output;
+            std::uint8_t size = 0;
+            char sequence[MaxPenSequence];
+
+            std::string_view prefix() const { return std::string_view(sequence, size); }
+        };
+
+        inline const CompiledPen& compilePen(const Pen& pen, ColorLevel level) {
+            constexpr std::size_t Slots = 256;
+            thread_local CompiledPen compiled[Slots];
+
+            // Attributes and level are spread over the key before the multiply, so that the top byte
+            // used as the slot depends on every field
+            std::uint64_t key = (std::uint64_t)pen.text << 32 | pen.background;
+            key ^= ((std::uint64_t)pen.attributes << 8 | (std::uint64_t)level) * 0xC2B2AE3D27D4EB4Full;
+            key *= 0x9E3779B97F4A7C15ull;
+            CompiledPen& slot = compiled[(key >> 56) & (Slots - 1)];
+            if (!slot.valid || slot.pen != pen || slot.level != level) {
+                slot.pen = pen;
+                slot.level = level;
+                slot.output = downsample(pen, level);
+                slot.size = (std::uint8_t)encodePen(slot.sequence, Pen(), slot.output);
+                slot.valid = true;
+            }
+            return slot;
+        }
+    }
+
+    // Number of terminal cells UTF-8 text takes (wide characters take two, combining marks none)
+    inline std::size_t displayWidth(std::string_view text) {
+        const char* p = text.data();
+        const char* end = p + text.size();
+        std::size_t width = 0;
+        while (p < end) {
+            std::size_t run = detail::printableAscii(p, (std::size_t)(end - p));
+            width += run;
+            p += run;
+            if (p < end) {
+                width += (std::size_t)detail::codepointWidth(detail::decodeUtf8(p, end));
+            }
+        }
+        return width;
+    }
+
+    // Longest start of the text that fits into width cells, never cuts a character in half
+    inline std::string_view truncateToWidth(std::string_view text, std::size_t width) {
+        const char* p = text.data();
+        const char* end = p + text.size();
+        while (p < end) {
+            std::size_t run = std::min(detail::printableAscii(p, (std::size_t)(end - p)), width);
+            width -= run;
+            p += run;
+            if (p == end || width == 0) {
+                break;
+            }
+            const char* next = p;
+            std::size_t cells = (std::size_t)detail::codepointWidth(detail::decodeUtf8(next, end));
+            if (cells > width) {
+                break;
+            }
+            width -= cells;
+            p = next;
+        }
+        // Zero width characters (combining marks) after the last cell still belong to it
+        while (p < end && (unsigned char)*p >= 0x80) {
+            const char* next = p;
+            if (detail::codepointWidth(detail::decodeUtf8(next, end)) != 0) {
+                break;
+            }
+            p = next;
+        }
+        return text.substr(0, (std::size_t)(p - text.data()));
+    }
+
+    /*
+        Style
+        Colors and attributes are packed like Pen (8 bit RGB, attribute bits), together with width and
+        alignment the appearance takes 12 bytes next to the text view. The SGR prefix is compiled once per
+        pen, color level and thread and cached (see detail::compilePen), inserting the same Style again
+        copies it.
+    */
     class Style {
     private:
-        static const bool HasTrueTextColor = 1 << 1;
-        static const bool HasTrueBgColor = 1 << 2;
-        bool m_flags = 0;
-        bool m_bold = false;
-        int  m_width = -1;
-        TextColor m_textColor = TextColor::None;
-        BackgroundColor m_bgColor = BackgroundColor::None;
-        Color m_trueTextColor;
-        Color m_trueBgColor;
+        std::uint32_t m_textColor = Pen::NoColor;
+        std::uint32_t m_bgColor = Pen::NoColor;
+        std::int16_t m_width = -1;
+        std::uint8_t m_attributes = 0;
         Aligment m_alignment = Aligment::Left;
         std::string_view m_view = "";
     public:
         Style() {}
         Style(const std::string_view& view) : m_view(view) {}
-        Style& black() { m_textColor = TextColor::Black; return *this; }
-        Style& red() { m_textColor = TextColor::Red; return *this; }
-        Style& green() { m_textColor = TextColor::Green; return *this; }
-        Style& yellow() { m_textColor = TextColor::Yellow; return *this; }
-        Style& blue() { m_textColor = TextColor::Blue; return *this; }
-        Style& magenta() { m_textColor = TextColor::Magenta; return *this; }
-        Style& cyan() { m_textColor = TextColor::Cyan; return *this; }
-        Style& white() { m_textColor = TextColor::White; return *this; }
-
-        Style& bgBlack() { m_bgColor = BackgroundColor::Black; return *this; }
-        Style& bgRed() { m_bgColor = BackgroundColor::Red; return *this; }
-        Style& bgGreen() { m_bgColor = BackgroundColor::Green; return *this; }
-        Style& bgYellow() { m_bgColor = BackgroundColor::Yellow; return *this; }
-        Style& bgBlue() { m_bgColor = BackgroundColor::Blue; return *this; }
-        Style& bgMagenta() { m_bgColor = BackgroundColor::Magenta; return *this; }
-        Style& bgCyan() { m_bgColor = BackgroundColor::Cyan; return *this; }
-        Style& bgWhite() { m_bgColor = BackgroundColor::White; return *this; }
+        Style& black() { return color(TextColor::Black); }
+        Style& red() { return color(TextColor::Red); }
+        Style& green() { return color(TextColor::Green); }
+        Style& yellow() { return color(TextColor::Yellow); }
+        Style& blue() { return color(TextColor::Blue); }
+        Style& magenta() { return color(TextColor::Magenta); }
+        Style& cyan() { return color(TextColor::Cyan); }
+        Style& white() { return color(TextColor::White); }
+
+        Style& bgBlack() { return color(BackgroundColor::Black); }
+        Style& bgRed() { return color(BackgroundColor::Red); }
+        Style& bgGreen() { return color(BackgroundColor::Green); }
+        Style& bgYellow() { return color(BackgroundColor::Yellow); }
+        Style& bgBlue() { return color(BackgroundColor::Blue); }
+        Style& bgMagenta() { return color(BackgroundColor::Magenta); }
+        Style& bgCyan() { return color(BackgroundColor::Cyan); }
+        Style& bgWhite() { return color(BackgroundColor::White); }
 
         Style& color(const TextColor& color) {
-            m_textColor = color;
+            m_textColor = Pen::basic((int)color);
             return *this;
         }
 
         Style& color(const BackgroundColor& color) {
-            m_bgColor = color;
+            m_bgColor = Pen::basic((int)color);
             return *this;
         }
 
         Style& color(const Color& color) {
-            m_trueTextColor = color;
-            m_flags |= HasTrueTextColor;
+            m_textColor = Pen::rgb(color);
             return *this;
         }
 
         Style& background(const Color& color) {
-            m_trueBgColor = color;
-            m_flags |= HasTrueBgColor;
+            m_bgColor = Pen::rgb(color);
             return *this;
         }
 
-        Style& bold() { m_bold = true; return *this; }
+        Style& bold() { m_attributes |= Pen::Bold; return *this; }
+        Style& dim() { m_attributes |= Pen::Dim; return *this; }
+        Style& underscore() { m_attributes |= Pen::Underscore; return *this; }
+        Style& blink() { m_attributes |= Pen::Blink; return *this; }
+        Style& reverse() { m_attributes |= Pen::Reverse; return *this; }
+        Style& hidden() { m_attributes |= Pen::Hidden; return *this; }
 
-        Style& width(int value) { m_width = value;  return *this; }
+        Style& width(int value) { m_width = (std::int16_t)(value < -1 ? -1 : value > INT16_MAX ? INT16_MAX : value); return *this; }
         Style& left() { m_alignment = Aligment::Left;  return *this; }
         Style& right() { m_alignment = Aligment::Right;  return *this; }
         Style& center() { m_alignment = Aligment::Center;  return *this; }
 
+        int getWidth() const { return m_width; }
+        Aligment getAlignment() const { return m_alignment; }
+        std::string_view getText() const { return m_view; }
+
         Style& text(const std::string_view& view) {
             m_view = view;
             return *this;
         }
 
-        friend std::ostream& operator<<(std::ostream& out, const Style& style) {
-            if (style.m_textColor != TextColor::None) {
-                out << style.m_textColor;
-            }
-            if (style.m_bgColor != BackgroundColor::None) {
-                out << style.m_bgColor;
-            }
-            if (style.m_flags && Style::HasTrueTextColor) {
-                out << "\x1b[38;2;"
-                    << style.m_trueTextColor.r << ";"
-                    << style.m_trueTextColor.g << ";"
-                    << style.m_trueTextColor.b << ";"
-                    << "0m";
-            }
-            if (style.m_flags && Style::HasTrueBgColor) {
-                out << "\x1b[48;2;"
-                    << style.m_trueBgColor.r << ";"
-                    << style.m_trueBgColor.g << ";"
-                    << style.m_trueBgColor.b << ";"
-                    << "0m";
-            }
-            if (style.m_bold) {
-                out << Attribute::Bold;
-            }
-
-            if (style.m_bold) {
-                out << Attribute::Bold;
-            }
+        Pen pen() const {
+            Pen pen;
+            pen.text = m_textColor;
+            pen.background = m_bgColor;
+            pen.attributes = m_attributes;
+            return pen;
+        }
 
-            auto flags = out.flags();
+        // SGR sequence that sets this style starting from the default pen
+        std::string_view prefix(ColorLevel level = ColorLevel::TrueColor) const {
+            return detail::compilePen(pen(), level).prefix();
+        }
 
-            if (style.m_width > -1) {
-                switch (style.m_alignment) {
-                case Aligment::Left: {
-                    out << std::left;
-                    out << std::setw(style.m_width);
+        // Writes the text padded with spaces to width cells (display width, not bytes),
+        // the pen has to be set by the caller
+        void writeText(std::ostream& out) const {
+            std::size_t before = 0;
+            std::size_t after = 0;
+            if (m_width > 0) {
+                std::size_t width = displayWidth(m_view);
+                std::size_t padding = (std::size_t)m_width > width ? (std::size_t)m_width - width : 0;
+                switch (m_alignment) {
+                case Aligment::Left:
+                    after = padding;
                     break;
-                }
                 case Aligment::Right:
-                    out << std::right;
-                    out << std::setw(style.m_width);
+                    before = padding;
                     break;
                 case Aligment::Center:
-                    //BUG: Centering text is not working well
-                    int padding = (style.m_width - style.m_view.length()) / 2;
-                    if (padding > 0) {
-                        out << std::string(padding, 'x');
-                    }
+                    before = padding / 2;
+                    after = padding - before;
                     break;
                 }
             }
+            detail::writePadding(out, before);
+            out.write(m_view.data(), (std::streamsize)m_view.size());
+            detail::writePadding(out, after);
+        }
+
+        friend std::ostream& operator<<(std::ostream& out, const Style& style);
+    };
+
+    static_assert(sizeof(Style) <= 16 + sizeof(std::string_view), "Style appearance should stay packed");
+
+    namespace detail
+    {
+        constexpr int sgrParameter(TextColor color) { return (int)color; }
+        constexpr int sgrParameter(BackgroundColor color) { return (int)color; }
+        constexpr int sgrParameter(Attribute attribute) { return (int)attribute; }
+
+        constexpr std::size_t digitCount(int value) { return value >= 100 ? 3 : value >= 10 ? 2 : 1; }
+
+        // <ESC>[{a};{b};...m built at compile time
+        template <auto... Values>
+        struct SgrSequence {
+            static_assert(sizeof...(Values) > 0, "at least one color or attribute is required");
+
+            static constexpr int parameters[] = { sgrParameter(Values)... };
+            static constexpr std::size_t size = 2 + (digitCount(sgrParameter(Values)) + ...) + sizeof...(Values);
+
+            static constexpr std::array<char, size> make() {
+                std::array<char, size> sequence{};
+                std::size_t p = 0;
+                sequence[p++] = '\x1b';
+                sequence[p++] = '[';
+                for (std::size_t i = 0; i < sizeof...(Values); i++) {
+                    if (i > 0) {
+                        sequence[p++] = ';';
+                    }
+                    int value = parameters[i];
+                    std::size_t digits = digitCount(value);
+                    for (std::size_t d = digits; d > 0; d--) {
+                        sequence[p + d - 1] = (char)('0' + value % 10);
+                        value /= 10;
+                    }
+                    p += digits;
+                }
+                sequence[p++] = 'm';
+                return sequence;
+            }
+
+            static constexpr std::array<char, size> value = make();
+        };
+
+        // Brings a Console to the default pen before a Styled, defined after Console
+        inline bool resetForStyled(std::ostream& out);
+    }
 
-            out << style.m_view;
-            out << Attribute::Reset;
+    /*
+        Styled
+        Style fixed at compile time: styled<TextColor::White, BackgroundColor::Red, Attribute::Bold>(text)
+        The opening and closing sequences are constexpr arrays, so writing one is a copy of a
+        static string, the text and the closing reset. Padding (left aligned) is the only runtime part.
+    */
+    template <auto... Values>
+    class Styled {
+    private:
+        std::string_view m_view;
+        int m_width = -1;
+    public:
+        static constexpr std::string_view prefix{ detail::SgrSequence<Values...>::value.data(), detail::SgrSequence<Values...>::size };
+        static constexpr std::string_view suffix = "\x1b[m";
+
+        constexpr explicit Styled(std::string_view view) : m_view(view) {}
+
+        constexpr Styled& width(int value) { m_width = value; return *this; }
+
+        friend std::ostream& operator<<(std::ostream& out, const Styled& styled) {
+            std::ostream::sentry guard(out);
+            if (!guard) {
+                return out;
+            }
+            if (!detail::resetForStyled(out)) {
+                out.setstate(std::ios_base::badbit);
+                return out;
+            }
+            // Basic colors and attributes only, so the sequences are either written as they are or not at all
+            bool plain = detail::streamColorLevel(out) == ColorLevel::None;
+            std::string_view prefix = Styled::prefix.substr(0, plain ? 0 : Styled::prefix.size());
+            std::string_view suffix = Styled::suffix.substr(0, plain ? 0 : Styled::suffix.size());
+            std::size_t size = styled.m_view.size();
+            std::size_t width = styled.m_width > 0 ? displayWidth(styled.m_view) : 0;
+            std::size_t padding = styled.m_width > (int)width ? (std::size_t)styled.m_width - width : 0;
+            std::size_t total = prefix.size() + size + padding + suffix.size();
+
+            // Short texts are assembled on the stack and handed over as one block
+            char block[256];
+            if (total <= sizeof(block) && padding <= detail::SpaceRun.size()) {
+                char* p = block;
+                std::memcpy(p, prefix.data(), prefix.size());
+                p += prefix.size();
+                std::memcpy(p, styled.m_view.data(), size);
+                p += size;
+                std::memcpy(p, detail::SpaceRun.data(), padding);
+                p += padding;
+                std::memcpy(p, suffix.data(), suffix.size());
+                if (out.rdbuf()->sputn(block, (std::streamsize)total) != (std::streamsize)total) {
+                    out.setstate(std::ios_base::badbit);
+                }
+                return out;
+            }
 
-            out.flags(flags);
+            out.write(prefix.data(), (std::streamsize)prefix.size());
+            out.write(styled.m_view.data(), (std::streamsize)size);
+            detail::writePadding(out, padding);
+            out.write(suffix.data(), (std::streamsize)suffix.size());
             return out;
         }
     };
 
+    template <auto... Values>
+    constexpr Styled<Values...> styled(std::string_view view) { return Styled<Values...>(view); }
+
     class Cursor {
     private:
         CursorMovement operation = CursorMovement::None;
@@ -386,188 +958,2423 @@ namespace terminal
         }
     };
 
-    class Console : std::streambuf, public std::ostream
+    namespace detail
     {
-    private:
-        int level;
-    public:
-        Console() : std::ostream(this), level(0) {}
+#if defined(_WIN32)
+        inline long writeFd(int fd, const char* data, std::size_t size) { return _write(fd, data, (unsigned int)size); }
+        inline bool isTerminal(int fd) { return _isatty(fd) != 0; }
+#else
+        inline long writeFd(int fd, const char* data, std::size_t size) { return (long)::write(fd, data, size); }
+        inline bool isTerminal(int fd) { return ::isatty(fd) != 0; }
+#endif
+
+        inline bool environmentFlag(const char* name) {
+            const char* value = std::getenv(name);
+            return value != nullptr && *value != '\0' && std::strcmp(value, "0") != 0;
+        }
 
-        void enterLevel() { level++; }
-        void exitLevel() { if (level > 0) level--; }
-        void resetLevel() { level = 0; }
+        // Colors the terminal announces through TERM and COLORTERM, read once
+        inline ColorLevel environmentColorLevel() {
+            static const ColorLevel level = [] {
+                std::string_view term = std::getenv("TERM") ? std::getenv("TERM") : "";
+                std::string_view colorTerm = std::getenv("COLORTERM") ? std::getenv("COLORTERM") : "";
+                if (term == "dumb") {
+                    return ColorLevel::None;
+                }
+                if (colorTerm == "truecolor" || colorTerm == "24bit" || term.find("direct") != std::string_view::npos) {
+                    return ColorLevel::TrueColor;
+                }
+                if (term.find("256color") != std::string_view::npos) {
+                    return ColorLevel::Colors256;
+                }
+#if defined(_WIN32)
+                // Windows 10 consoles with virtual terminal processing take 24 bit colors
+                if (term.empty()) {
+                    return ColorLevel::TrueColor;
+                }
+#endif
+                return ColorLevel::Colors16;
+            }();
+            return level;
+        }
 
-        virtual std::streambuf::int_type overflow(std::streambuf::int_type c) {
-            if (c == '\n') {
-                if (putchar('\n') != EOF) {
-                    for (int i = 0; i < level * 4; i++) {
-                        if (putchar(' ') == EOF) {
-                            return EOF;
-                        }
+        /*
+            Colors to use for a file descriptor
+            NO_COLOR turns them off, a file or pipe that is not a terminal gets none unless CLICOLOR_FORCE
+            or FORCE_COLOR is set. Without a file descriptor (-1, memory and recording sinks) the output
+            is kept for a terminal later on and gets the colors of the environment.
+        */
+        inline bool colorsForced() { return environmentFlag("CLICOLOR_FORCE") || environmentFlag("FORCE_COLOR"); }
+
+        inline bool plainOutput(int fd) { return fd >= 0 && !isTerminal(fd) && !colorsForced(); }
+
+        inline ColorLevel detectColorLevel(int fd) {
+            const char* noColor = std::getenv("NO_COLOR");
+            if (noColor != nullptr && *noColor != '\0') {
+                return ColorLevel::None;
+            }
+            if (plainOutput(fd)) {
+                return ColorLevel::None;
+            }
+            return environmentColorLevel();
+        }
+
+        // Rows and columns of the terminal behind fd, false when it is not a terminal or can not tell
+        inline bool terminalSize(int fd, int& rows, int& columns) {
+#if defined(_WIN32)
+            (void)fd; (void)rows; (void)columns;
+            return false;
+#else
+            winsize size;
+            if (::ioctl(fd, TIOCGWINSZ, &size) != 0 || size.ws_row == 0 || size.ws_col == 0) {
+                return false;
+            }
+            rows = size.ws_row;
+            columns = size.ws_col;
+            return true;
+#endif
+        }
+
+        inline int terminalColumns(int fd, int fallback = 80) {
+            int rows = 0;
+            int columns = fallback;
+            terminalSize(fd, rows, columns);
+            return columns;
+        }
+
+#if defined(TERMINAL_STATS)
+        // Write calls made by the calling thread, Console takes the difference around its writes
+        struct WriteCounts {
+            std::uint64_t syscalls = 0;
+            std::uint64_t partialWrites = 0;
+        };
+
+        inline WriteCounts& writeCounts() {
+            thread_local WriteCounts counts;
+            return counts;
+        }
+#endif
+
+        inline void countWrite(long written, std::size_t requested) {
+#if defined(TERMINAL_STATS)
+            WriteCounts& counts = writeCounts();
+            counts.syscalls++;
+            if (written >= 0 && (std::size_t)written < requested) {
+                counts.partialWrites++;
+            }
+#else
+            (void)written; (void)requested;
+#endif
+        }
+
+        // Writes the whole range, retrying on partial writes and EINTR.
+        inline bool writeAll(int fd, const char* data, std::size_t size) {
+            while (size > 0) {
+                long written = writeFd(fd, data, size);
+                countWrite(written, size);
+                if (written < 0) {
+                    if (errno == EINTR) {
+                        continue;
                     }
+                    return false;
                 }
-                return c;
+                data += written;
+                size -= (std::size_t)written;
             }
-            if (c != EOF) {
-                if (putchar(c) == EOF) {
-                    return EOF;
+            return true;
+        }
+
+        // Writes what the fd takes without waiting: the count written, 0 when it would block, -1 on failure
+        inline long tryWriteFd(int fd, const char* data, std::size_t size) {
+            while (true) {
+                long written = writeFd(fd, data, size);
+                countWrite(written, size);
+                if (written >= 0) {
+                    return written;
                 }
+                if (errno == EINTR) {
+                    continue;
+                }
+                return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
             }
-            return c;
         }
 
-        void notice(const std::string_view& view) { block(Style(view).bgBlue().white().width(80)); }
-        void error(const std::string_view& view) { block(Style(view).bgRed().white().width(80)); }
-        void warning(const std::string_view& view) { block(Style(view).bgYellow().blue().width(80)); }
-        void success(const std::string_view& view) { block(Style(view).bgGreen().white().width(80)); }
-
-    private:
-        void block(const Style& textStyle) {
-            *this << "\n";
-            *this << textStyle;
-            *this << "\n";
+        // Waits until a non-blocking fd can take more output, false on failure
+        inline bool waitWritable(int fd) {
+#if defined(_WIN32)
+            (void)fd;
+            return true;
+#else
+            pollfd target = { fd, POLLOUT, 0 };
+            while (true) {
+                int ready = ::poll(&target, 1, -1);
+                if (ready >= 0) {
+                    return (target.revents & (POLLERR | POLLNVAL)) == 0;
+                }
+                if (errno != EINTR) {
+                    return false;
+                }
+            }
+#endif
         }
-    };
 
-    /* Terminal stream output */
+#if !defined(_WIN32)
+        // Terminal without echo and line editing (signals still work) until destroyed
+        class RawMode {
+        private:
+            int m_fd;
+            bool m_active = false;
+            termios m_saved;
+        public:
+            explicit RawMode(int fd) : m_fd(fd) {
+                if (::tcgetattr(fd, &m_saved) != 0) {
+                    return;
+                }
+                termios raw = m_saved;
+                raw.c_lflag &= ~(tcflag_t)(ICANON | ECHO);
+                raw.c_cc[VMIN] = 0;
+                raw.c_cc[VTIME] = 0;
+                m_active = ::tcsetattr(fd, TCSANOW, &raw) == 0;
+            }
 
-    std::ostream& operator<<(std::ostream& out, Terminal terminal) {
-        switch (terminal) {
-        case Terminal::ResetDevice: {
-            out << "\x1b[c";
-        } break;
-        case Terminal::EnableLineWrap: {
-            out << "\x1b[7h";
-        } break;
-        case Terminal::DisableLineWrap: {
-            out << "\x1b[7l";
-        } break;
-        }
-        return out;
-    }
+            ~RawMode() {
+                if (m_active) {
+                    ::tcsetattr(m_fd, TCSANOW, &m_saved);
+                }
+            }
 
-    /* TabControl stream output */
+            RawMode(const RawMode&) = delete;
+            RawMode& operator=(const RawMode&) = delete;
+
+            bool isActive() const { return m_active; }
+        };
 
-    std::ostream& operator<<(std::ostream& out, TabControl value) {
-        switch (value) {
-        case TabControl::SetTab: {
-            out << "\x1bH";
-        } break;
-        case TabControl::ClearTab: {
-            out << "\x1b[g";
-        } break;
-        case TabControl::ClearAllTab: {
-            out << "\x1b[3g";
-        } break;
+        // Waits for input at most timeout, returns the number of bytes read, 0 on timeout and -1 on errors
+        inline long readInput(int fd, char* data, std::size_t size, std::chrono::milliseconds timeout) {
+            pollfd request = { fd, POLLIN, 0 };
+            int ready = ::poll(&request, 1, (int)timeout.count());
+            if (ready <= 0) {
+                return ready < 0 && errno != EINTR ? -1 : 0;
+            }
+            long count = (long)::read(fd, data, size);
+            return count < 0 && (errno == EINTR || errno == EAGAIN) ? 0 : count;
         }
-        return out;
+#endif
     }
 
-    /* EraseText stream output */
+    /*
+        EscapeFilter
+        Removes ESC sequences (CSI, OSC/DCS/APC strings, charset and other two byte sequences)
+        from a byte stream and keeps everything else. Text is scanned with memchr from one ESC
+        to the next, so plain text costs a single vectorized search. The state survives between
+        calls, a sequence split across two writes is still removed as a whole.
+    */
+    class EscapeFilter {
+    private:
+        enum class State : std::uint8_t {
+            Text,
+            Escape,         // after ESC
+            Intermediate,   // ESC followed by 0x20-0x2F, e.g. ESC ( B
+            Csi,            // ESC [ until a final byte 0x40-0x7E
+            String,         // ESC ] P X ^ _ until BEL or the string terminator ESC \ (ST)
+            StringEscape    // ESC inside a string
+        };
+        State m_state = State::Text;
+    public:
+        // Calls run(data, size) for every piece of text outside of sequences, stops when it returns false
+        template <class Run>
+        bool scan(const char* data, std::size_t size, Run run) {
+            const char* end = data + size;
+            while (data < end) {
+                if (m_state == State::Text) {
+                    const char* found = (const char*)std::memchr(data, '\x1b', (std::size_t)(end - data));
+                    const char* stop = found ? found : end;
+                    if (stop > data && !run(data, (std::size_t)(stop - data))) {
+                        return false;
+                    }
+                    if (found == nullptr) {
+                        return true;
+                    }
+                    data = found + 1;
+                    m_state = State::Escape;
+                    continue;
+                }
+                data = skip(data, end);
+            }
+            return true;
+        }
 
-    std::ostream& operator<<(std::ostream& out, EraseText value) {
-        switch (value) {
-        case EraseText::EraseEndOfLine: {
-            out << "\x1b[K";
-        } break;
-        case EraseText::EraseStartOfLine: {
-            out << "\x1b[1K";
-        } break;
-        case EraseText::EraseLine: {
-            out << "\x1b[2K";
-        } break;
-        case EraseText::EraseDown: {
-            out << "\x1b[J";
-        } break;
-        case EraseText::EraseUp: {
-            out << "\x1b[1J";
-        } break;
-        case EraseText::EraseScreen: {
-            out << "\x1b[2J";
-        } break;
+        // Writes the text of [data, data + size) to out (which may be data itself), returns its length
+        std::size_t filter(const char* data, std::size_t size, char* out) {
+            char* p = out;
+            scan(data, size, [&p](const char* text, std::size_t length) {
+                std::memmove(p, text, length);
+                p += length;
+                return true;
+            });
+            return (std::size_t)(p - out);
         }
-        return out;
-    }
 
-    /* Color stream output */
+        // True while a sequence started by an earlier call is still open
+        bool inSequence() const { return m_state != State::Text; }
+        void reset() { m_state = State::Text; }
 
-    std::ostream& operator<<(std::ostream& out, TextColor color) {
-        out << "\x1b[" << (int)color << 'm';
-        return out;
-    }
+    private:
+        // Advances through sequence bytes until the sequence ends or the input does
+        const char* skip(const char* data, const char* end) {
+            while (data < end && m_state != State::Text) {
+                unsigned char c = (unsigned char)*data++;
+                switch (m_state) {
+                case State::Escape:
+                    if (c == '[') {
+                        m_state = State::Csi;
+                    } else if (c == ']' || c == 'P' || c == 'X' || c == '^' || c == '_') {
+                        m_state = State::String;
+                    } else if (c >= 0x20 && c <= 0x2F) {
+                        m_state = State::Intermediate;
+                    } else if (c != 0x1b) {
+                        m_state = State::Text;
+                    }
+                    break;
+                case State::Intermediate:
+                    if (c < 0x20 || c > 0x2F) {
+                        m_state = c == 0x1b ? State::Escape : State::Text;
+                    }
+                    break;
+                case State::Csi:
+                    // ESC cancels the sequence and starts a new one
+                    if (c == 0x1b) {
+                        m_state = State::Escape;
+                    } else if (c >= 0x40 && c <= 0x7E) {
+                        m_state = State::Text;
+                    }
+                    break;
+                case State::String: {
+                    const char* stop = data - 1;
+                    while (stop < end && *stop != '\a' && *stop != '\x1b') {
+                        stop++;
+                    }
+                    data = stop < end ? stop + 1 : end;
+                    if (stop < end) {
+                        m_state = *stop == '\a' ? State::Text : State::StringEscape;
+                    }
+                    break;
+                }
+                case State::StringEscape:
+                    // Anything but ST cancels the string and starts a new sequence
+                    m_state = c == '\\' ? State::Text : State::Escape;
+                    data -= c == '\\' ? 0 : 1;
+                    break;
+                default:
+                    break;
+                }
+            }
+            return data;
+        }
+    };
 
-    std::ostream& operator<<(std::ostream& out, BackgroundColor color) {
-        out << "\x1b[" << (int)color << 'm';
-        return out;
+    // Removes all escape sequences from a complete block, out may be data itself
+    inline std::size_t stripEscapes(const char* data, std::size_t size, char* out) {
+        EscapeFilter filter;
+        return filter.filter(data, size, out);
     }
 
-    std::ostream& operator<<(std::ostream& out, Attribute sequence) {
-        out << "\x1b[" << (int)sequence << 'm';
-        return out;
+    inline std::string stripEscapes(std::string_view text) {
+        std::string result(text.size(), '\0');
+        result.resize(stripEscapes(text.data(), text.size(), &result[0]));
+        return result;
     }
 
-    /* Cursor Movement Output */
+    enum class Key : std::uint8_t {
+        None,
+        Escape,
+        Up, Down, Right, Left,
+        Home, End, Insert, Delete, PageUp, PageDown,
+        F1, F2, F3, F4, F5, F6, F7, F8, F9, F10, F11, F12
+    };
 
-    std::ostream& operator<<(std::ostream& out, const Cursor& cursor) {
-        auto operation = cursor.getOperation();
-        auto rowOrCount = cursor.getCount();
-        auto col = cursor.getColumn();
+    /*
+        InputEvent
+        Text        Bytes that are not part of a sequence, text points into the chunk given to InputParser::feed
+        Key         Cursor, editing or function key, modifiers are Shift = 1, Alt = 2, Control = 4
+        Device      Device status report (ReportDeviceCode, ReportDeviceOK/Failure or ReportCursorPosition)
+    */
+    struct InputEvent {
+        enum class Type : std::uint8_t { Text, Key, Device };
+        static constexpr std::uint8_t Shift = 1;
+        static constexpr std::uint8_t Alt = 2;
+        static constexpr std::uint8_t Control = 4;
+
+        Type type = Type::Text;
+        Key key = Key::None;
+        std::uint8_t modifiers = 0;
+        Device device = Device::reportDeviceOK();
+        std::string_view text;
+    };
+
+    /*
+        InputParser
+        Turns raw terminal input into InputEvents. Input may arrive in chunks of any size, a sequence
+        cut between two chunks is completed by the next feed(). Nothing is allocated: parameters are
+        kept in a fixed array and text events point into the fed chunk.
+        A lone ESC can not be told apart from the start of a sequence until more input arrives,
+        flush() reports it as Key::Escape (call it when reading timed out).
+        Sequences that are neither keys nor device reports are skipped.
+    */
+    class InputParser {
+    private:
+        static constexpr int MaxParameters = 8;
+
+        enum class State : std::uint8_t {
+            Text,
+            Escape,     // after ESC
+            Csi,        // ESC [ parameters
+            Ss3,        // ESC O, followed by a single key byte
+            Ignore      // rest of an unsupported or overlong CSI
+        };
+
+        State m_state = State::Text;
+        bool m_private = false;
+        int m_count = 0;
+        int m_parameters[MaxParameters] = {};
+    public:
+        // Calls handler(const InputEvent&) for every complete event in [data, data + size)
+        template <class Handler>
+        void feed(const char* data, std::size_t size, Handler&& handler) {
+            const char* end = data + size;
+            while (data < end) {
+                if (m_state == State::Text) {
+                    const char* found = (const char*)std::memchr(data, '\x1b', (std::size_t)(end - data));
+                    const char* stop = found ? found : end;
+                    if (stop > data) {
+                        InputEvent event;
+                        event.text = std::string_view(data, (std::size_t)(stop - data));
+                        handler(event);
+                    }
+                    if (found == nullptr) {
+                        return;
+                    }
+                    data = found + 1;
+                    m_state = State::Escape;
+                    continue;
+                }
+                step(data++, handler);
+            }
+        }
 
-        out << "\x1b[";
+        bool pending() const { return m_state != State::Text; }
 
-        switch (operation)
-        {
-        case CursorMovement::Home: {
-            out << "[" << rowOrCount << ";" << col;
-        } break;
-        case CursorMovement::Up: {
-            out << "[" << rowOrCount;
-        } break;
-        case CursorMovement::Down: {
-            out << "[" << rowOrCount;
-        } break;
-        case CursorMovement::Forward: {
-            out << "[" << rowOrCount;
-        } break;
-        case CursorMovement::Backward: {
-            out << "[" << rowOrCount;
-        } break;
-        case CursorMovement::ForcePosition: {
-            out << "[" << rowOrCount << ";" << col;
-        } break;
-        case CursorMovement::SaveCursor: {
-            out << "[";
-        } break;
-        case CursorMovement::RestoreCursor: {
-            out << "[";
-        } break;
-            //case CursorMovement::SaveCursorAndAttrs: {
-            //} break;
-            //case CursorMovement::RestoreCursorAndAttrs: {
-            //} break;
-        }
-        out << operation;
+        // Reports a lone ESC that was not followed by a sequence, drops an incomplete sequence
+        template <class Handler>
+        void flush(Handler&& handler) {
+            if (m_state == State::Escape) {
+                handler(keyEvent(Key::Escape, 0));
+            }
+            m_state = State::Text;
+        }
 
-        return out;
-    }
+    private:
+        static InputEvent keyEvent(Key key, int modifier) {
+            InputEvent event;
+            event.type = InputEvent::Type::Key;
+            event.key = key;
+            // xterm sends modifiers as 1 + Shift | Alt | Control
+            event.modifiers = modifier > 1 ? (std::uint8_t)((modifier - 1) & 7) : 0;
+            return event;
+        }
 
-    /* Scroll Output */
+        static InputEvent deviceEvent(const Device& device) {
+            InputEvent event;
+            event.type = InputEvent::Type::Device;
+            event.device = device;
+            return event;
+        }
 
-    std::ostream& operator<<(std::ostream& out, const Scroll& scroll) {
-        switch (scroll.getScrollType()) {
-        case Scrolling::ScrollScreen: {
-            out << "\x1b[r";
-        } break;
-        case Scrolling::ScrollFromPosition: {
-            out << "\x1b[" << scroll.getStart() << ";" << scroll.getEnd() << "r";
-        } break;
-        case Scrolling::ScrollUp: {
-            out << "\x1bM";
-        } break;
-        case Scrolling::ScrollDown: {
-            out << "\x1b" << "D";
-        } break;
+        int parameter(int index, int fallback) const {
+            return index < m_count && m_parameters[index] > 0 ? m_parameters[index] : fallback;
         }
-        return out;
-    }
+
+        static Key letterKey(unsigned char c) {
+            switch (c) {
+            case 'A': return Key::Up;
+            case 'B': return Key::Down;
+            case 'C': return Key::Right;
+            case 'D': return Key::Left;
+            case 'H': return Key::Home;
+            case 'F': return Key::End;
+            case 'P': return Key::F1;
+            case 'Q': return Key::F2;
+            case 'R': return Key::F3;
+            case 'S': return Key::F4;
+            default: return Key::None;
+            }
+        }
+
+        // ESC [ {n} ~ keys (vt220 and xterm numbering)
+        static Key tildeKey(int code) {
+            switch (code) {
+            case 1: case 7: return Key::Home;
+            case 2: return Key::Insert;
+            case 3: return Key::Delete;
+            case 4: case 8: return Key::End;
+            case 5: return Key::PageUp;
+            case 6: return Key::PageDown;
+            case 11: return Key::F1;
+            case 12: return Key::F2;
+            case 13: return Key::F3;
+            case 14: return Key::F4;
+            case 15: return Key::F5;
+            case 17: return Key::F6;
+            case 18: return Key::F7;
+            case 19: return Key::F8;
+            case 20: return Key::F9;
+            case 21: return Key::F10;
+            case 23: return Key::F11;
+            case 24: return Key::F12;
+            default: return Key::None;
+            }
+        }
+
+        template <class Handler>
+        void step(const char* at, Handler& handler) {
+            unsigned char c = (unsigned char)*at;
+            switch (m_state) {
+            case State::Escape:
+                if (c == '[') {
+                    m_state = State::Csi;
+                    m_private = false;
+                    m_count = 0;
+                } else if (c == 'O') {
+                    m_state = State::Ss3;
+                } else if (c == 0x1b) {
+                    handler(keyEvent(Key::Escape, 0));
+                } else {
+                    // Alt + key: reported as Escape followed by the key as text
+                    m_state = State::Text;
+                    handler(keyEvent(Key::Escape, 0));
+                    InputEvent event;
+                    event.text = std::string_view(at, 1);
+                    handler(event);
+                }
+                return;
+            case State::Ss3:
+                m_state = State::Text;
+                if (Key key = letterKey(c); key != Key::None) {
+                    handler(keyEvent(key, 0));
+                }
+                return;
+            case State::Csi:
+                if (c >= '0' && c <= '9') {
+                    if (m_count == 0) {
+                        m_count = 1;
+                        m_parameters[0] = 0;
+                    }
+                    int& value = m_parameters[m_count - 1];
+                    value = value < 100000 ? value * 10 + (c - '0') : value;
+                } else if (c == ';') {
+                    if (m_count == 0) {
+                        m_parameters[m_count++] = 0;
+                    }
+                    if (m_count == MaxParameters) {
+                        m_state = State::Ignore;
+                        return;
+                    }
+                    m_parameters[m_count++] = 0;
+                } else if (c >= 0x3C && c <= 0x3F) {
+                    m_private = true;
+                } else if (c >= 0x40 && c <= 0x7E) {
+                    m_state = State::Text;
+                    finish(c, handler);
+                } else if (c == 0x1b) {
+                    // A sequence cut off by the start of the next one
+                    m_state = State::Escape;
+                    m_private = false;
+                    m_count = 0;
+                } else if (c < 0x20 || c > 0x7E) {
+                    m_state = State::Text;
+                }
+                return;
+            case State::Ignore:
+                if (c == 0x1b) {
+                    m_state = State::Escape;
+                    m_private = false;
+                    m_count = 0;
+                } else if (c >= 0x40 && c <= 0x7E) {
+                    m_state = State::Text;
+                }
+                return;
+            default:
+                return;
+            }
+        }
+
+        template <class Handler>
+        void finish(unsigned char final, Handler& handler) {
+            switch (final) {
+            case 'R':
+                // Cursor position report, a modified F3 (ESC [ 1 ; m R) is read the same way
+                handler(deviceEvent(Device::reportCursorPosition(parameter(0, 1), parameter(1, 1))));
+                return;
+            case 'n':
+                if (parameter(0, 0) == 0) {
+                    handler(deviceEvent(Device::reportDeviceOK()));
+                } else if (parameter(0, 0) == 3) {
+                    handler(deviceEvent(Device::reportDeviceFailure()));
+                }
+                return;
+            case 'c':
+                // Terminals answer ESC [ ? {code} ; ... c, the vt100 form is ESC [ {code} 0 c
+                handler(deviceEvent(Device::reportDeviceCode(m_private ? parameter(0, 0) : parameter(0, 0) / 10)));
+                return;
+            case '~':
+                if (Key key = tildeKey(parameter(0, 0)); key != Key::None) {
+                    handler(keyEvent(key, parameter(1, 1)));
+                }
+                return;
+            default:
+                if (Key key = letterKey(final); key != Key::None && !m_private) {
+                    handler(keyEvent(key, parameter(1, 1)));
+                }
+                return;
+            }
+        }
+    };
+
+    /*
+        Output sinks
+        Where a Console writes to. write() writes the whole range or fails, writev() writes several
+        ranges in order: one writev call on a file descriptor, appended one after the other in memory.
+        A sink is only used under the lock of its Console (or by its writer thread), never concurrently.
+            MemorySink memory;
+            Console con(memory);
+    */
+    struct Segment {
+        const char* data;
+        std::size_t size;
+    };
+
+    namespace detail
+    {
+        // Writes all segments, retrying on partial writes and EINTR. Windows has no writev, the segments are written one by one.
+        inline bool writevAll(int fd, const Segment* segments, std::size_t count) {
+#if defined(_WIN32)
+            for (std::size_t i = 0; i < count; i++) {
+                if (!writeAll(fd, segments[i].data, segments[i].size)) {
+                    return false;
+                }
+            }
+            return true;
+#else
+            constexpr std::size_t MaxVectors = 16;
+            iovec vectors[MaxVectors];
+            while (count > 0) {
+                std::size_t used = count < MaxVectors ? count : MaxVectors;
+                for (std::size_t i = 0; i < used; i++) {
+                    vectors[i].iov_base = (void*)segments[i].data;
+                    vectors[i].iov_len = segments[i].size;
+                }
+                iovec* current = vectors;
+                std::size_t left = used;
+                while (left > 0) {
+                    long written = (long)::writev(fd, current, (int)left);
+#if defined(TERMINAL_STATS)
+                    std::size_t requested = 0;
+                    for (std::size_t i = 0; i < left; i++) {
+                        requested += current[i].iov_len;
+                    }
+                    countWrite(written, requested);
+#endif
+                    if (written < 0) {
+                        if (errno == EINTR) {
+                            continue;
+                        }
+                        return false;
+                    }
+                    while (left > 0 && (std::size_t)written >= current->iov_len) {
+                        written -= (long)current->iov_len;
+                        current++;
+                        left--;
+                    }
+                    if (left > 0) {
+                        current->iov_base = (char*)current->iov_base + written;
+                        current->iov_len -= (std::size_t)written;
+                    }
+                }
+                segments += used;
+                count -= used;
+            }
+            return true;
+#endif
+        }
+    }
+
+    class Sink {
+    public:
+        virtual ~Sink() {}
+
+        virtual bool write(const char* data, std::size_t size) = 0;
+
+        virtual bool writev(const Segment* segments, std::size_t count) {
+            for (std::size_t i = 0; i < count; i++) {
+                if (segments[i].size > 0 && !write(segments[i].data, segments[i].size)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Writes what can be written without waiting, returns the count written (0 when it would block) or -1 on failure
+        virtual long tryWrite(const char* data, std::size_t size) { return write(data, size) ? (long)size : -1; }
+
+        // File descriptor behind the sink (to detect a terminal), -1 when there is none
+        virtual int getFd() const { return -1; }
+    };
+
+    // File descriptor owned by someone else (stdout, a pty, a socket)
+    class FdSink : public Sink {
+    private:
+        int m_fd;
+    public:
+        explicit FdSink(int fd) : m_fd(fd) {}
+
+        virtual bool write(const char* data, std::size_t size) { return detail::writeAll(m_fd, data, size); }
+        virtual bool writev(const Segment* segments, std::size_t count) { return detail::writevAll(m_fd, segments, count); }
+        virtual long tryWrite(const char* data, std::size_t size) { return detail::tryWriteFd(m_fd, data, size); }
+        virtual int getFd() const { return m_fd; }
+    };
+
+    // Growable buffer, e.g. for tests. Read it after the Console was flushed.
+    class MemorySink : public Sink {
+    private:
+        std::string m_data;
+    public:
+        MemorySink() {}
+        explicit MemorySink(std::size_t capacity) { m_data.reserve(capacity); }
+
+        virtual bool write(const char* data, std::size_t size) {
+            m_data.append(data, size);
+            return true;
+        }
+
+        virtual bool writev(const Segment* segments, std::size_t count) {
+            std::size_t total = m_data.size();
+            for (std::size_t i = 0; i < count; i++) {
+                total += segments[i].size;
+            }
+            if (total > m_data.capacity()) {
+                m_data.reserve(std::max(total, m_data.capacity() * 2));
+            }
+            for (std::size_t i = 0; i < count; i++) {
+                m_data.append(segments[i].data, segments[i].size);
+            }
+            return true;
+        }
+
+        const std::string& getData() const { return m_data; }
+        std::size_t size() const { return m_data.size(); }
+        void clear() { m_data.clear(); }
+    };
+
+    // File opened (created or truncated unless appending) and closed by the sink
+    class FileSink : public FdSink {
+    public:
+        explicit FileSink(const char* path, bool append = false) : FdSink(open(path, append)) {}
+
+        ~FileSink() {
+            if (getFd() >= 0) {
+#if defined(_WIN32)
+                _close(getFd());
+#else
+                ::close(getFd());
+#endif
+            }
+        }
+
+        FileSink(const FileSink&) = delete;
+        FileSink& operator=(const FileSink&) = delete;
+
+        bool isOpen() const { return getFd() >= 0; }
+
+    private:
+        static int open(const char* path, bool append) {
+#if defined(_WIN32)
+            int flags = _O_WRONLY | _O_CREAT | _O_BINARY | (append ? _O_APPEND : _O_TRUNC);
+            return _open(path, flags, _S_IREAD | _S_IWRITE);
+#else
+            int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC);
+            return ::open(path, flags, 0666);
+#endif
+        }
+    };
+
+    /*
+        What an asynchronous Console does when its ring is full
+        Block       Wait until the writer thread has made room.
+        Drop        Discard the chunk that does not fit (counted by getDroppedBytes).
+        Grow        Continue in a ring twice as large, the writer switches over once the old one is drained.
+    */
+    enum class AsyncPolicy {
+        Block,
+        Drop,
+        Grow
+    };
+
+    /*
+        AsyncWriter
+        Lock-free single producer / single consumer byte ring drained to a Sink
+        by a dedicated writer thread. push() and flush() must not be called concurrently,
+        Console calls both under the lock of its link.
+        The mutex and condition variables are used only to park a thread that has nothing to do.
+    */
+    class AsyncWriter {
+    private:
+        struct Ring {
+            std::unique_ptr<char[]> data;
+            std::size_t mask;
+            alignas(64) std::atomic<std::size_t> head{ 0 };
+            alignas(64) std::atomic<std::size_t> tail{ 0 };
+            std::atomic<Ring*> next{ nullptr };
+
+            explicit Ring(std::size_t capacity) : data(new char[capacity]), mask(capacity - 1) {}
+            std::size_t capacity() const { return mask + 1; }
+        };
+
+        Sink& m_sink;
+        AsyncPolicy m_policy;
+        Ring* m_producer;
+        Ring* m_consumer;
+        std::atomic<std::uint64_t> m_pushed{ 0 };
+        std::atomic<std::uint64_t> m_written{ 0 };
+        std::atomic<std::uint64_t> m_dropped{ 0 };
+#if defined(TERMINAL_STATS)
+        std::atomic<std::uint64_t> m_syscalls{ 0 };
+        std::atomic<std::uint64_t> m_partialWrites{ 0 };
+#endif
+        std::atomic<bool> m_failed{ false };
+        std::atomic<bool> m_stop{ false };
+        std::atomic<bool> m_writerIdle{ false };
+        std::atomic<int> m_producerWaiters{ 0 };
+        std::mutex m_mutex;
+        std::condition_variable m_wakeWriter;
+        std::condition_variable m_wakeProducer;
+        std::thread m_thread;
+    public:
+        static constexpr std::size_t DefaultCapacity = 1024 * 1024;
+
+        AsyncWriter(Sink& sink, std::size_t capacity = DefaultCapacity, AsyncPolicy policy = AsyncPolicy::Block) :
+            m_sink(sink), m_policy(policy), m_producer(new Ring(roundCapacity(capacity))), m_consumer(m_producer)
+        {
+            m_thread = std::thread([this] { run(); });
+        }
+
+        // Drains everything that was pushed before stopping the writer thread
+        ~AsyncWriter() {
+            m_stop.store(true);
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_wakeWriter.notify_one();
+            }
+            m_thread.join();
+            delete m_consumer;
+        }
+
+        AsyncWriter(const AsyncWriter&) = delete;
+        AsyncWriter& operator=(const AsyncWriter&) = delete;
+
+        AsyncPolicy getPolicy() const { return m_policy; }
+        std::uint64_t getDroppedBytes() const { return m_dropped.load(std::memory_order_relaxed); }
+        std::uint64_t getQueuedBytes() const { return m_pushed.load(std::memory_order_relaxed) - m_written.load(std::memory_order_relaxed); }
+
+#if defined(TERMINAL_STATS)
+        // Write calls of the writer thread
+        std::uint64_t getSyscalls() const { return m_syscalls.load(std::memory_order_relaxed); }
+        std::uint64_t getPartialWrites() const { return m_partialWrites.load(std::memory_order_relaxed); }
+
+        void resetCounts() {
+            m_syscalls.store(0, std::memory_order_relaxed);
+            m_partialWrites.store(0, std::memory_order_relaxed);
+        }
+#endif
+
+        bool push(const char* data, std::size_t size) {
+            while (size > 0) {
+                Ring* ring = m_producer;
+                std::size_t tail = ring->tail.load(std::memory_order_relaxed);
+                std::size_t space = ring->capacity() - (tail - ring->head.load(std::memory_order_acquire));
+
+                if (space < size && m_policy != AsyncPolicy::Block) {
+                    if (m_policy == AsyncPolicy::Drop) {
+                        m_dropped.fetch_add(size, std::memory_order_relaxed);
+                        return !m_failed.load(std::memory_order_relaxed);
+                    }
+                    grow(size);
+                    continue;
+                }
+                if (space == 0) {
+                    waitProducer([&] { return ring->head.load() != tail - ring->capacity(); });
+                    continue;
+                }
+
+                std::size_t count = space < size ? space : size;
+                std::size_t offset = tail & ring->mask;
+                std::size_t first = ring->capacity() - offset < count ? ring->capacity() - offset : count;
+                std::memcpy(ring->data.get() + offset, data, first);
+                std::memcpy(ring->data.get(), data + first, count - first);
+                ring->tail.store(tail + count);
+                m_pushed.fetch_add(count, std::memory_order_relaxed);
+                wakeWriter();
+
+                data += count;
+                size -= count;
+            }
+            return !m_failed.load(std::memory_order_relaxed);
+        }
+
+        // Barrier: returns once everything pushed so far has been written to the file descriptor
+        bool flush() {
+            std::uint64_t target = m_pushed.load(std::memory_order_relaxed);
+            waitProducer([&] { return m_written.load() >= target; });
+            return !m_failed.load(std::memory_order_relaxed);
+        }
+
+    private:
+        static std::size_t roundCapacity(std::size_t capacity) {
+            std::size_t size = 64;
+            while (size < capacity) {
+                size *= 2;
+            }
+            return size;
+        }
+
+        void grow(std::size_t size) {
+            Ring* ring = new Ring(roundCapacity(std::max(m_producer->capacity() * 2, size)));
+            m_producer->next.store(ring, std::memory_order_release);
+            m_producer = ring;
+        }
+
+        void wakeWriter() {
+            if (m_writerIdle.load()) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_wakeWriter.notify_one();
+            }
+        }
+
+        template <class Predicate>
+        void waitProducer(Predicate ready) {
+            if (ready()) {
+                return;
+            }
+            // Counted, the producer and a flush can wait at the same time
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_producerWaiters.fetch_add(1);
+            m_wakeProducer.wait(lock, ready);
+            m_producerWaiters.fetch_sub(1);
+        }
+
+        void run() {
+            Ring* ring = m_consumer;
+            for (;;) {
+                bool stopping = m_stop.load();
+                std::size_t head = ring->head.load(std::memory_order_relaxed);
+                std::size_t tail = ring->tail.load(std::memory_order_acquire);
+
+                if (head != tail) {
+                    std::size_t offset = head & ring->mask;
+                    std::size_t count = tail - head;
+                    std::size_t first = ring->capacity() - offset < count ? ring->capacity() - offset : count;
+                    // After a failed write the ring is still drained so the producer never waits forever
+                    Segment segments[2] = { { ring->data.get() + offset, first }, { ring->data.get(), count - first } };
+#if defined(TERMINAL_STATS)
+                    detail::WriteCounts before = detail::writeCounts();
+#endif
+                    if (!m_sink.writev(segments, first < count ? 2 : 1)) {
+                        m_failed.store(true, std::memory_order_relaxed);
+                    }
+#if defined(TERMINAL_STATS)
+                    const detail::WriteCounts& after = detail::writeCounts();
+                    m_syscalls.fetch_add(after.syscalls - before.syscalls, std::memory_order_relaxed);
+                    m_partialWrites.fetch_add(after.partialWrites - before.partialWrites, std::memory_order_relaxed);
+#endif
+                    ring->head.store(tail);
+                    m_written.fetch_add(count);
+                    if (m_producerWaiters.load() > 0) {
+                        std::lock_guard<std::mutex> lock(m_mutex);
+                        m_wakeProducer.notify_all();
+                    }
+                    continue;
+                }
+
+                Ring* next = ring->next.load(std::memory_order_acquire);
+                if (next != nullptr) {
+                    // The producer never returns to a ring once it has linked the next one
+                    if (ring->tail.load(std::memory_order_acquire) == head) {
+                        delete ring;
+                        ring = next;
+                        m_consumer = ring;
+                    }
+                    continue;
+                }
+                if (stopping) {
+                    return;
+                }
+
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_writerIdle.store(true);
+                m_wakeWriter.wait(lock, [&] {
+                    return ring->tail.load() != head || ring->next.load() != nullptr || m_stop.load();
+                });
+                m_writerIdle.store(false);
+            }
+        }
+    };
+
+    /*
+        Flush policy of the Console buffer
+        Full        Buffer is written when it is full or when flush() is called.
+        Line        Buffer is written after every completed line (default when writing to a terminal).
+        OnDestruct  Buffer grows as needed and is written only by flush() or when Console is destroyed.
+    */
+    enum class FlushPolicy {
+        Full,
+        Line,
+        OnDestruct
+    };
+
+    // Severity of the Console message helpers, from the first to be shed to the last
+    enum class Severity {
+        Success,
+        Notice,
+        Warning,
+        Error
+    };
+
+    /*
+        Overload policy of notice(), warning(), error() and success()
+        coalesce    An identical consecutive message is only counted, the count is written as
+                    "last message repeated N times" before the next message or on flush.
+        limit       Token bucket per severity: rate messages a second, at most burst at once (rate 0: no limit).
+        highWater   Bytes written but not yet out (buffer, unsent and queued output) above which successes
+                    and notices are dropped, above twice as many warnings too (0: never). Errors are
+                    only limited by their bucket.
+        Dropped messages are counted (Console::getDroppedMessages) and reported as "N messages dropped"
+        before the next message that is written.
+    */
+    struct OverloadPolicy {
+        struct Limit {
+            double rate = 0;
+            double burst = 1;
+        };
+
+        bool coalesce = true;
+        Limit limits[4];
+        std::size_t highWater = 0;
+
+        OverloadPolicy& limit(Severity severity, double rate, double burst) {
+            limits[(int)severity].rate = rate;
+            limits[(int)severity].burst = burst > 1 ? burst : 1;
+            return *this;
+        }
+
+        OverloadPolicy& shedAbove(std::size_t bytes) {
+            highWater = bytes;
+            return *this;
+        }
+    };
+
+    /*
+        Snapshot of the counters of a Console (Console::stats)
+        Counted only when compiled with TERMINAL_STATS defined, otherwise every field stays zero and
+        the output path has no counting code at all. Bytes are counted as they leave the buffer, split
+        into payload and escape sequences by class: SGR, cursor (movement, save and restore), erase
+        (erase, insert and delete), scroll (region, scroll, index) and other sequences.
+        Flushes are hand-overs of the buffer, syscalls and partial writes are made by the file
+        descriptor sinks, blocked is the time spent in the sink (or waiting for the async ring).
+    */
+    struct ConsoleStats {
+        std::uint64_t payloadBytes = 0;
+        std::uint64_t sgrBytes = 0;
+        std::uint64_t cursorBytes = 0;
+        std::uint64_t eraseBytes = 0;
+        std::uint64_t scrollBytes = 0;
+        std::uint64_t otherEscapeBytes = 0;
+        std::uint64_t flushes = 0;
+        std::uint64_t syscalls = 0;
+        std::uint64_t partialWrites = 0;
+        std::size_t bufferHighWater = 0;
+        std::chrono::nanoseconds blocked{ 0 };
+
+        std::uint64_t escapeBytes() const { return sgrBytes + cursorBytes + eraseBytes + scrollBytes + otherEscapeBytes; }
+    };
+
+    class Console;
+
+    namespace detail
+    {
+        // Sees everything a Console writes, called under the lock of its link
+        struct OutputHook {
+            virtual ~OutputHook() {}
+            virtual bool output(Console& owner, const char* data, std::size_t size) = 0;
+        };
+
+        // Shared between a Console and its per-thread consoles, which may outlive it
+        struct ConsoleLink {
+            std::mutex mutex;
+            Console* owner = nullptr;
+            OutputHook* hook = nullptr;
+        };
+
+        // What the overload policy of a Console remembers between messages
+        class Overload {
+        private:
+            OverloadPolicy m_policy;
+            double m_tokens[4];
+            std::chrono::steady_clock::time_point m_refilled[4];
+            std::string m_last;
+            Severity m_lastSeverity = Severity::Notice;
+            bool m_hasLast = false;
+        public:
+            std::uint64_t repeats = 0;
+            std::uint64_t unreported = 0;
+            std::uint64_t dropped[4] = { 0, 0, 0, 0 };
+
+            explicit Overload(const OverloadPolicy& policy) : m_policy(policy) {
+                auto now = std::chrono::steady_clock::now();
+                for (int i = 0; i < 4; i++) {
+                    m_tokens[i] = m_policy.limits[i].burst;
+                    m_refilled[i] = now;
+                }
+            }
+
+            const OverloadPolicy& getPolicy() const { return m_policy; }
+
+            bool repeated(Severity severity, std::string_view text) const {
+                return m_policy.coalesce && m_hasLast && severity == m_lastSeverity && text == m_last;
+            }
+
+            // Sheds by backlog first, then takes a token of the severity
+            bool admit(Severity severity, std::size_t backlog) {
+                std::size_t highWater = m_policy.highWater;
+                if (highWater > 0 && severity != Severity::Error &&
+                    backlog > (severity == Severity::Warning ? 2 * highWater : highWater)) {
+                    return false;
+                }
+                int index = (int)severity;
+                const OverloadPolicy::Limit& limit = m_policy.limits[index];
+                if (limit.rate <= 0) {
+                    return true;
+                }
+                auto now = std::chrono::steady_clock::now();
+                double elapsed = std::chrono::duration<double>(now - m_refilled[index]).count();
+                m_refilled[index] = now;
+                m_tokens[index] = std::min(limit.burst, m_tokens[index] + elapsed * limit.rate);
+                if (m_tokens[index] < 1) {
+                    return false;
+                }
+                m_tokens[index] -= 1;
+                return true;
+            }
+
+            void written(Severity severity, std::string_view text) {
+                m_last.assign(text.data(), text.size());
+                m_lastSeverity = severity;
+                m_hasLast = true;
+            }
+        };
+
+#if defined(TERMINAL_STATS)
+        /*
+            Counters of a Console, relaxed atomics so stats() can be read from any thread.
+            The sequence scanner belongs to the thread writing the Console and keeps its state
+            across hand-overs, a sequence split between two of them is counted once.
+        */
+        class OutputCounters {
+        private:
+            enum class State : std::uint8_t { Text, Escape, Csi, String, StringEscape };
+            enum Class { Payload, Sgr, Cursor, Erase, Scroll, Other, Classes };
+
+            State m_state = State::Text;
+            std::uint64_t m_sequence = 0;
+            std::atomic<std::uint64_t> m_bytes[Classes];
+            std::atomic<std::uint64_t> m_flushes{ 0 };
+            std::atomic<std::uint64_t> m_syscalls{ 0 };
+            std::atomic<std::uint64_t> m_partialWrites{ 0 };
+            std::atomic<std::size_t> m_highWater{ 0 };
+            std::atomic<std::int64_t> m_blocked{ 0 };
+        public:
+            OutputCounters() { reset(); }
+
+            // One hand-over to the sink
+            void handOver(const Segment* segments, std::size_t count) {
+                m_flushes.fetch_add(1, std::memory_order_relaxed);
+                std::uint64_t counts[Classes] = {};
+                for (std::size_t i = 0; i < count; i++) {
+                    scan(segments[i].data, segments[i].size, counts);
+                }
+                for (int i = 0; i < Classes; i++) {
+                    if (counts[i] > 0) {
+                        m_bytes[i].fetch_add(counts[i], std::memory_order_relaxed);
+                    }
+                }
+            }
+
+            void buffered(std::size_t used) {
+                if (used > m_highWater.load(std::memory_order_relaxed)) {
+                    m_highWater.store(used, std::memory_order_relaxed);
+                }
+            }
+
+            void wrote(const WriteCounts& before, std::chrono::steady_clock::time_point start) {
+                const WriteCounts& after = writeCounts();
+                m_syscalls.fetch_add(after.syscalls - before.syscalls, std::memory_order_relaxed);
+                m_partialWrites.fetch_add(after.partialWrites - before.partialWrites, std::memory_order_relaxed);
+                m_blocked.fetch_add((std::chrono::steady_clock::now() - start).count(), std::memory_order_relaxed);
+            }
+
+            ConsoleStats snapshot() const {
+                ConsoleStats stats;
+                stats.payloadBytes = m_bytes[Payload].load(std::memory_order_relaxed);
+                stats.sgrBytes = m_bytes[Sgr].load(std::memory_order_relaxed);
+                stats.cursorBytes = m_bytes[Cursor].load(std::memory_order_relaxed);
+                stats.eraseBytes = m_bytes[Erase].load(std::memory_order_relaxed);
+                stats.scrollBytes = m_bytes[Scroll].load(std::memory_order_relaxed);
+                stats.otherEscapeBytes = m_bytes[Other].load(std::memory_order_relaxed);
+                stats.flushes = m_flushes.load(std::memory_order_relaxed);
+                stats.syscalls = m_syscalls.load(std::memory_order_relaxed);
+                stats.partialWrites = m_partialWrites.load(std::memory_order_relaxed);
+                stats.bufferHighWater = m_highWater.load(std::memory_order_relaxed);
+                stats.blocked = std::chrono::steady_clock::duration(m_blocked.load(std::memory_order_relaxed));
+                return stats;
+            }
+
+            void reset() {
+                for (auto& bytes : m_bytes) {
+                    bytes.store(0, std::memory_order_relaxed);
+                }
+                m_flushes.store(0, std::memory_order_relaxed);
+                m_syscalls.store(0, std::memory_order_relaxed);
+                m_partialWrites.store(0, std::memory_order_relaxed);
+                m_highWater.store(0, std::memory_order_relaxed);
+                m_blocked.store(0, std::memory_order_relaxed);
+            }
+
+        private:
+            static Class escapeClass(unsigned char final) {
+                switch (final) {
+                case '7': case '8':
+                    return Cursor;
+                case 'D': case 'M':
+                    return Scroll;
+                default:
+                    return Other;
+                }
+            }
+
+            static Class csiClass(unsigned char final) {
+                switch (final) {
+                case 'm':
+                    return Sgr;
+                case 'A': case 'B': case 'C': case 'D': case 'E': case 'F': case 'G':
+                case 'H': case 'f': case 'd': case 's': case 'u':
+                    return Cursor;
+                case 'J': case 'K': case 'X': case '@': case 'P': case 'L': case 'M':
+                    return Erase;
+                case 'r': case 'S': case 'T':
+                    return Scroll;
+                default:
+                    return Other;
+                }
+            }
+
+            void finish(Class type, std::uint64_t* counts) {
+                counts[type] += m_sequence;
+                m_sequence = 0;
+                m_state = State::Text;
+            }
+
+            // Text runs are skipped with memchr, only bytes of sequences are looked at one by one
+            void scan(const char* data, std::size_t size, std::uint64_t* counts) {
+                const char* p = data;
+                const char* end = data + size;
+                while (p < end) {
+                    if (m_state == State::Text) {
+                        const char* found = (const char*)std::memchr(p, 0x1b, (std::size_t)(end - p));
+                        if (found == nullptr) {
+                            counts[Payload] += (std::uint64_t)(end - p);
+                            return;
+                        }
+                        counts[Payload] += (std::uint64_t)(found - p);
+                        p = found + 1;
+                        m_sequence = 1;
+                        m_state = State::Escape;
+                        continue;
+                    }
+                    unsigned char c = (unsigned char)*p++;
+                    m_sequence++;
+                    switch (m_state) {
+                    case State::Escape:
+                        if (c == '[') {
+                            m_state = State::Csi;
+                        } else if (c == ']' || c == 'P' || c == '_' || c == '^' || c == 'X') {
+                            m_state = State::String;
+                        } else if (c < 0x20 || c > 0x2f) {
+                            finish(escapeClass(c), counts);
+                        }
+                        break;
+                    case State::Csi:
+                        if (c >= 0x40 && c <= 0x7e) {
+                            finish(csiClass(c), counts);
+                        }
+                        break;
+                    case State::String:
+                        if (c == 0x07) {
+                            finish(Other, counts);
+                        } else if (c == 0x1b) {
+                            m_state = State::StringEscape;
+                        }
+                        break;
+                    case State::StringEscape:
+                        if (c == '\\') {
+                            finish(Other, counts);
+                        } else {
+                            m_state = State::String;
+                        }
+                        break;
+                    case State::Text:
+                        break;
+                    }
+                }
+            }
+        };
+#endif
+    }
+
+    class Console : std::streambuf, public std::ostream
+    {
+    public:
+        static constexpr std::size_t DefaultBufferSize = 16 * 1024;
+    private:
+        int level;
+        std::unique_ptr<Sink> m_ownedSink;
+        Sink* m_sink;
+        FlushPolicy m_policy;
+        std::vector<char> m_buffer;
+        Pen m_pen;
+        // Set by a raw color or attribute insert, the terminal pen is then not known
+        bool m_rawPen = false;
+        ColorLevel m_colors;
+        bool m_strip = false;
+        EscapeFilter m_filter;
+        bool m_styled = false;
+        int m_frames = 0;
+        bool m_synchronized = true;
+        // The fd of the sink is a terminal, frames are only synchronized there
+        bool m_terminal = false;
+        bool m_nonBlocking = false;
+        std::unique_ptr<detail::Overload> m_overload;
+#if defined(TERMINAL_STATS)
+        detail::OutputCounters m_counters;
+#endif
+        // Guarded by the lock of m_link: output the fd did not take yet in non-blocking mode, from m_sent on
+        std::string m_unsent;
+        std::size_t m_sent = 0;
+        // A write failed and tryFlush() has not reported it yet
+        bool m_failedUnreported = false;
+#if defined(__cpp_impl_coroutine)
+        std::vector<std::coroutine_handle<>> m_waiters;
+#endif
+        std::unique_ptr<AsyncWriter> m_async;
+        std::shared_ptr<detail::ConsoleLink> m_link;
+        std::shared_ptr<detail::ConsoleLink> m_parent;
+    public:
+        Console(int fd = 1, std::size_t bufferSize = DefaultBufferSize) :
+            Console(fd, detail::isTerminal(fd) ? FlushPolicy::Line : FlushPolicy::Full, bufferSize)
+        { }
+
+        Console(int fd, FlushPolicy policy, std::size_t bufferSize = DefaultBufferSize) :
+            Console(std::unique_ptr<Sink>(new FdSink(fd)), policy, bufferSize)
+        { }
+
+        // Writes to a sink that outlives the Console, a terminal is detected by the fd of the sink
+        Console(Sink& sink, std::size_t bufferSize = DefaultBufferSize) :
+            Console(sink, detail::isTerminal(sink.getFd()) ? FlushPolicy::Line : FlushPolicy::Full, bufferSize)
+        { }
+
+        Console(Sink& sink, FlushPolicy policy, std::size_t bufferSize = DefaultBufferSize) :
+            std::ostream(this), level(0), m_sink(&sink), m_policy(policy), m_buffer(bufferSize > 0 ? bufferSize : 1),
+            m_link(std::make_shared<detail::ConsoleLink>())
+        {
+            int fd = sink.getFd();
+            m_link->owner = this;
+            m_strip = detail::plainOutput(fd);
+            m_terminal = fd >= 0 && detail::isTerminal(fd);
+            setColorLevel(detail::detectColorLevel(fd));
+            setPosition(0);
+        }
+
+        ~Console() {
+            if (m_frames > 0) {
+                m_frames = 1;
+                endFrame();
+            }
+            reportOverload();
+            resetPen();
+            flushBuffer();
+            {
+                std::lock_guard<std::mutex> lock(m_link->mutex);
+                drainUnsent(true);
+                m_link->owner = nullptr;
+            }
+#if defined(__cpp_impl_coroutine)
+            // Coroutines still waiting in flushed() learn that the Console is gone, they would leak otherwise
+            if (!m_waiters.empty()) {
+                setstate(std::ios_base::badbit);
+                std::vector<std::coroutine_handle<>> waiters;
+                waiters.swap(m_waiters);
+                for (std::coroutine_handle<> waiter : waiters) {
+                    waiter.resume();
+                }
+            }
+#endif
+            m_async.reset();
+        }
+
+        Console(const Console&) = delete;
+        Console& operator=(const Console&) = delete;
+
+        void enterLevel() { level++; setPosition(pending()); }
+        void exitLevel() { if (level > 0) level--; setPosition(pending()); }
+        void resetLevel() { level = 0; setPosition(pending()); }
+
+        int getFd() const { return m_sink->getFd(); }
+        Sink& getSink() const { return *m_sink; }
+        FlushPolicy getFlushPolicy() const { return m_policy; }
+        std::size_t getBufferSize() const { return m_buffer.size(); }
+        ColorLevel getColorLevel() const { return m_colors; }
+        bool getStripEscapes() const { return m_strip; }
+
+        void setFlushPolicy(FlushPolicy policy) {
+            m_policy = policy;
+            setPosition(pending());
+        }
+
+        // Colors are detected at construction, styles are downsampled to what is set here
+        void setColorLevel(ColorLevel colors) {
+            resetPen();
+            m_colors = colors;
+            iword(detail::colorLevelIndex()) = (long)outputColors() + 1;
+        }
+
+        /*
+            Removes every escape sequence written from now on, on by default when the Console writes to a
+            file descriptor that is not a terminal (and colors are not forced). Text and indentation are kept.
+        */
+        void setStripEscapes(bool strip) {
+            resetPen();
+            m_strip = strip;
+            m_filter.reset();
+            iword(detail::colorLevelIndex()) = (long)outputColors() + 1;
+            setPosition(pending());
+        }
+
+        void setBufferSize(std::size_t size) {
+            flushBuffer();
+            m_buffer.assign(size > 0 ? size : 1, '\0');
+            setPosition(0);
+        }
+
+        // From now on flushing only hands the buffer to a writer thread, flush() waits for it
+        void startAsync(std::size_t capacity = AsyncWriter::DefaultCapacity, AsyncPolicy policy = AsyncPolicy::Block) {
+            stopAsync();
+            std::lock_guard<std::mutex> lock(m_link->mutex);
+            m_async.reset(new AsyncWriter(*m_sink, capacity, policy));
+        }
+
+        // Writes everything that is still queued and returns to synchronous writes
+        void stopAsync() {
+            flushBuffer();
+            std::lock_guard<std::mutex> lock(m_link->mutex);
+            m_async.reset();
+        }
+
+        /*
+            Frames collect everything written between beginFrame() and endFrame() in the buffer, which
+            grows as needed, and hand it over as one write: flushes and flush policies wait for the end
+            of the outermost frame, nested frames are part of it. On a terminal the frame is wrapped in
+            synchronized update mode (?2026), so the terminal shows it at once instead of half drawn.
+            Terminals that do not know the mode ignore it.
+                {
+                    Console::Frame frame(con);
+                    con << Cursor::home(1, 1) << EraseText::EraseEndOfLine << status;
+                }
+        */
+        class Frame {
+        private:
+            Console& m_console;
+        public:
+            explicit Frame(Console& console) : m_console(console) { m_console.beginFrame(); }
+            ~Frame() { m_console.endFrame(); }
+
+            Frame(const Frame&) = delete;
+            Frame& operator=(const Frame&) = delete;
+        };
+
+        void beginFrame() {
+            if (m_frames++ > 0) {
+                return;
+            }
+            if (!resetPen() || !flushBuffer()) {
+                setstate(std::ios_base::badbit);
+            }
+            if (synchronizes()) {
+                writeRun("\x1b[?2026h", 8);
+            }
+        }
+
+        // Ends the outermost frame with a single write, returns false when it could not be written
+        bool endFrame() {
+            if (m_frames == 0 || --m_frames > 0) {
+                return true;
+            }
+            bool written = resetPen();
+            if (synchronizes()) {
+                written = writeRun("\x1b[?2026l", 8) && written;
+            }
+            written = flushBuffer() && written && flushAsync();
+            if (!written) {
+                setstate(std::ios_base::badbit);
+            }
+            return written;
+        }
+
+        bool inFrame() const { return m_frames > 0; }
+
+        // Synchronized update mode around frames on a terminal, on by default (never used while escapes are stripped)
+        void setSynchronizedOutput(bool synchronized) { m_synchronized = synchronized; }
+        bool getSynchronizedOutput() const { return m_synchronized; }
+
+        /*
+            Non-blocking mode for event loops, the fd has to be O_NONBLOCK. Whatever the fd does not take
+            (EAGAIN, partial writes) is kept and written before any later output, so the order holds and
+            nothing waits. pollOut() tells when the loop should wait for the fd to become writable and
+            call tryFlush(). Leaving the mode and destroying the Console wait for the unsent bytes.
+                if (!con.tryFlush()) watch(con.getFd(), EPOLLOUT);
+        */
+        void setNonBlocking(bool nonBlocking) {
+            if (!nonBlocking && m_nonBlocking) {
+                flushBuffer();
+                std::lock_guard<std::mutex> lock(m_link->mutex);
+                drainUnsent(true);
+            }
+            m_nonBlocking = nonBlocking;
+        }
+
+        bool isNonBlocking() const { return m_nonBlocking; }
+
+        // Hands the buffer over and writes as much as the fd takes, true when nothing is left
+        bool tryFlush() {
+            bool done = flushNonBlocking();
+#if defined(__cpp_impl_coroutine)
+            if (done || bad()) {
+                std::vector<std::coroutine_handle<>> waiters;
+                waiters.swap(m_waiters);
+                for (std::coroutine_handle<> waiter : waiters) {
+                    waiter.resume();
+                }
+            }
+#endif
+            return done;
+        }
+
+        // True while unsent bytes wait for the fd to become writable, or a failed write waits for
+        // tryFlush() to report it (and to resume the coroutines waiting in flushed())
+        bool pollOut() const {
+            std::lock_guard<std::mutex> lock(m_link->mutex);
+            return m_sent < m_unsent.size() || m_failedUnreported;
+        }
+
+        std::size_t getUnsentBytes() const {
+            std::lock_guard<std::mutex> lock(m_link->mutex);
+            return m_unsent.size() - m_sent;
+        }
+
+#if defined(__cpp_impl_coroutine)
+        /*
+            co_await con.flushed() completes at once when tryFlush() could write everything, otherwise
+            the coroutine is resumed by the tryFlush() call of the event loop that writes the rest, or
+            that meets the failed write (pollOut() stays true until the failure is reported), or by
+            the destructor of the Console. Yields false when the output failed or the Console is gone.
+        */
+        struct FlushAwaiter {
+            Console& console;
+
+            // A Console that failed before (or is being destroyed) is not written to again
+            bool await_ready() { return console.bad() || console.flushNonBlocking() || console.bad(); }
+            void await_suspend(std::coroutine_handle<> handle) { console.m_waiters.push_back(handle); }
+            bool await_resume() const { return !console.bad(); }
+        };
+
+        FlushAwaiter flushed() { return FlushAwaiter{ *this }; }
+#endif
+
+        bool isAsync() const { return m_async != nullptr; }
+        std::uint64_t getDroppedBytes() const { return m_async ? m_async->getDroppedBytes() : 0; }
+
+        /*
+            Console of the calling thread that writes through this one.
+            It has its own buffer, nesting level and pen and hands over only complete lines,
+            each commit is a single write made under a lock that is never held while formatting.
+            Line policy by default, Full policy batches several complete lines into one commit.
+            Output still buffered when the thread ends is committed by its destructor.
+        */
+        Console& local() {
+            thread_local std::vector<std::unique_ptr<Console>> locals;
+            for (auto& console : locals) {
+                if (console->m_parent == m_link) {
+                    return *console;
+                }
+            }
+            locals.erase(std::remove_if(locals.begin(), locals.end(), [](const std::unique_ptr<Console>& console) {
+                std::lock_guard<std::mutex> lock(console->m_parent->mutex);
+                return console->m_parent->owner == nullptr;
+            }), locals.end());
+            locals.emplace_back(new Console(m_link, getFd(), m_buffer.size()));
+            locals.back()->setColorLevel(m_colors);
+            locals.back()->setStripEscapes(m_strip);
+            return *locals.back();
+        }
+
+        void notice(const std::string_view& view) { message(Severity::Notice, view); }
+        void error(const std::string_view& view) { message(Severity::Error, view); }
+        void warning(const std::string_view& view) { message(Severity::Warning, view); }
+        void success(const std::string_view& view) { message(Severity::Success, view); }
+
+        // Writes the message as the block of its severity, through the overload policy when one is set
+        void message(Severity severity, const std::string_view& view) {
+            if (!m_overload) {
+                writeMessage(severity, view);
+                return;
+            }
+            detail::Overload& overload = *m_overload;
+            if (overload.repeated(severity, view)) {
+                overload.repeats++;
+                return;
+            }
+            if (!overload.admit(severity, getBacklog())) {
+                overload.dropped[(int)severity]++;
+                overload.unreported++;
+                return;
+            }
+            reportOverload();
+            writeMessage(severity, view);
+            overload.written(severity, view);
+        }
+
+        // Messages are written as they come again after clearOverloadPolicy()
+        void setOverloadPolicy(const OverloadPolicy& policy) {
+            clearOverloadPolicy();
+            m_overload.reset(new detail::Overload(policy));
+        }
+
+        void clearOverloadPolicy() {
+            reportOverload();
+            m_overload.reset();
+        }
+
+        std::uint64_t getDroppedMessages(Severity severity) const {
+            return m_overload ? m_overload->dropped[(int)severity] : 0;
+        }
+
+        std::uint64_t getDroppedMessages() const {
+            std::uint64_t total = 0;
+            for (int i = 0; i < 4; i++) {
+                total += getDroppedMessages((Severity)i);
+            }
+            return total;
+        }
+
+        // Bytes written to the Console that did not reach the sink yet
+        std::size_t getBacklog() const {
+            std::size_t backlog = pending();
+            if (m_async) {
+                backlog += (std::size_t)m_async->getQueuedBytes();
+            }
+            if (m_nonBlocking) {
+                backlog += getUnsentBytes();
+            }
+            return backlog;
+        }
+
+        // Counters since construction or resetStats(), all zero unless compiled with TERMINAL_STATS
+        ConsoleStats stats() const {
+#if defined(TERMINAL_STATS)
+            ConsoleStats stats = m_counters.snapshot();
+            std::lock_guard<std::mutex> lock(m_link->mutex);
+            if (m_async) {
+                stats.syscalls += m_async->getSyscalls();
+                stats.partialWrites += m_async->getPartialWrites();
+            }
+            return stats;
+#else
+            return ConsoleStats();
+#endif
+        }
+
+        void resetStats() {
+#if defined(TERMINAL_STATS)
+            m_counters.reset();
+            std::lock_guard<std::mutex> lock(m_link->mutex);
+            if (m_async) {
+                m_async->resetCounts();
+            }
+#endif
+        }
+
+        /*
+            Sends a device query (cursor position, device status or device code) and waits for the report
+            on input, which is in raw mode meanwhile so the report is not echoed. Keys typed in the meantime
+            are discarded. Returns false on timeout, when input is not a terminal, while escape sequences
+            are stripped and on Windows.
+        */
+        bool query(const Device& request, Device& report,
+            std::chrono::milliseconds timeout = std::chrono::milliseconds(200), int input = 0)
+        {
+#if defined(_WIN32)
+            (void)request; (void)report; (void)timeout; (void)input;
+            return false;
+#else
+            DeviceStatus status = request.getStatus();
+            if (status != DeviceStatus::QueryCursorPosition && status != DeviceStatus::QueryDeviceStatus &&
+                status != DeviceStatus::QueryDeviceCode) {
+                return false;
+            }
+            if (m_strip || !detail::isTerminal(input)) {
+                return false;
+            }
+            detail::RawMode raw(input);
+            if (!raw.isActive()) {
+                return false;
+            }
+            *this << request;
+            if (!flush()) {
+                return false;
+            }
+
+            auto answers = [status](DeviceStatus reported) {
+                switch (status) {
+                case DeviceStatus::QueryCursorPosition:
+                    return reported == DeviceStatus::ReportCursorPosition;
+                case DeviceStatus::QueryDeviceStatus:
+                    return reported == DeviceStatus::ReportDeviceOK || reported == DeviceStatus::ReportDeviceFailure;
+                default:
+                    return reported == DeviceStatus::ReportDeviceCode;
+                }
+            };
+
+            InputParser parser;
+            bool found = false;
+            char data[256];
+            auto deadline = std::chrono::steady_clock::now() + timeout;
+            while (!found) {
+                auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+                if (left.count() <= 0) {
+                    break;
+                }
+                long count = detail::readInput(input, data, sizeof(data), left);
+                if (count < 0) {
+                    break;
+                }
+                parser.feed(data, (std::size_t)count, [&](const InputEvent& event) {
+                    if (!found && event.type == InputEvent::Type::Device && answers(event.device.getStatus())) {
+                        report = event.device;
+                        found = true;
+                    }
+                });
+            }
+            return found;
+#endif
+        }
+
+    protected:
+        virtual std::streambuf::int_type overflow(std::streambuf::int_type c) {
+            if (std::streambuf::traits_type::eq_int_type(c, std::streambuf::traits_type::eof())) {
+                return flushBuffer() ? std::streambuf::traits_type::not_eof(c) : std::streambuf::traits_type::eof();
+            }
+            char ch = std::streambuf::traits_type::to_char_type(c);
+            return xsputn(&ch, 1) == 1 ? c : std::streambuf::traits_type::eof();
+        }
+
+        virtual std::streamsize xsputn(const char* s, std::streamsize count) {
+            if (count <= 0) {
+                return 0;
+            }
+            if (!resetUnlessStyled()) {
+                return 0;
+            }
+            if (m_strip) {
+                return m_filter.scan(s, (std::size_t)count, [this](const char* text, std::size_t size) {
+                    return writeText(text, size);
+                }) ? count : 0;
+            }
+            // Lines of a per-thread console must not leave the pen set, another thread continues after them
+            bool written = m_parent && m_styled && !m_pen.isDefault() ?
+                writeStyledLines(s, (std::size_t)count) : writeText(s, (std::size_t)count);
+            return written ? count : 0;
+        }
+
+        virtual int sync() {
+            if (m_frames > 0) {
+                return 0;
+            }
+            reportOverload();
+            return resetPen() && flushBuffer() && flushAsync() ? 0 : -1;
+        }
+
+    private:
+        friend std::ostream& operator<<(std::ostream& out, const Style& style);
+        friend std::ostream& operator<<(std::ostream& out, TextColor color);
+        friend std::ostream& operator<<(std::ostream& out, BackgroundColor color);
+        friend std::ostream& operator<<(std::ostream& out, Attribute sequence);
+        friend bool detail::resetForStyled(std::ostream& out);
+        friend class LiveRegion;
+        friend class PinnedPanes;
+
+        Console(std::shared_ptr<detail::ConsoleLink> parent, int fd, std::size_t bufferSize) :
+            Console(fd, FlushPolicy::Line, bufferSize)
+        {
+            m_parent = std::move(parent);
+        }
+
+        Console(std::unique_ptr<Sink> sink, FlushPolicy policy, std::size_t bufferSize) :
+            Console(*sink, policy, bufferSize)
+        {
+            m_ownedSink = std::move(sink);
+        }
+
+        // Only the difference to the current pen is written and the reset after the text is
+        // deferred until plain text follows, the stream is flushed or the Console is destroyed.
+        void writeStyle(const Style& style) {
+            const detail::CompiledPen& compiled = detail::compilePen(style.pen(), outputColors());
+            Pen pen = compiled.output;
+            bool written;
+            if (!resetRawPen()) {
+                written = false;
+            } else if (m_pen.isDefault() && !pen.isDefault()) {
+                std::string_view prefix = compiled.prefix();
+                m_pen = pen;
+                written = writeRun(prefix.data(), prefix.size());
+            } else {
+                written = applyPen(pen);
+            }
+            if (!written) {
+                setstate(std::ios_base::badbit);
+                return;
+            }
+            m_styled = true;
+            style.writeText(*this);
+            m_styled = false;
+        }
+
+        bool applyPen(const Pen& pen) {
+            char sequence[detail::MaxPenSequence];
+            std::size_t size = detail::encodePen(sequence, m_pen, pen);
+            m_pen = pen;
+            return size == 0 || writeRun(sequence, size);
+        }
+
+        bool resetPen() { return applyPen(Pen()); }
+
+        ColorLevel outputColors() const { return m_strip ? ColorLevel::None : m_colors; }
+
+        bool resetUnlessStyled() { return m_styled || m_pen.isDefault() || resetPen(); }
+
+        bool synchronizes() const { return m_synchronized && m_terminal && !m_strip; }
+
+        // A raw SGR sequence was written, only a reset brings the pen back to a known state
+        void rawPen(bool reset) { m_rawPen = !reset && !m_strip; }
+
+        // m_pen is already default after a raw insert, the insert reset it before it was written
+        bool resetRawPen() {
+            if (!m_rawPen) {
+                return true;
+            }
+            m_rawPen = false;
+            return writeRun("\x1b[m", 3);
+        }
+
+        bool writeText(const char* data, std::size_t size) {
+            return intercepts() ? writeLines(data, size) : writeRun(data, size);
+        }
+
+        // Resets the pen before every newline of styled text and sets it again after it
+        bool writeStyledLines(const char* data, std::size_t size) {
+            Pen pen = m_pen;
+            while (size > 0) {
+                const char* found = (const char*)std::memchr(data, '\n', size);
+                if (found == nullptr) {
+                    return writeText(data, size);
+                }
+                std::size_t run = (std::size_t)(found - data);
+                if (!writeText(data, run) || !resetPen() || !writeText("\n", 1) || !applyPen(pen)) {
+                    return false;
+                }
+                data += run + 1;
+                size -= run + 1;
+            }
+            return true;
+        }
+
+        // Put area is closed (pptr == epptr) whenever every character has to be inspected,
+        // so newlines can be indented by the current level and line policy can flush, and while
+        // a pen waits for its deferred reset, so a single character put by sputc resets it first.
+        bool intercepts() const { return level > 0 || m_policy == FlushPolicy::Line || m_strip; }
+
+        std::size_t pending() const { return (std::size_t)(pptr() - pbase()); }
+        std::size_t available() const { return m_buffer.size() - pending(); }
+
+        void setPosition(std::size_t used) {
+            char* base = m_buffer.data();
+            setp(base, intercepts() || !m_pen.isDefault() ? base + used : base + m_buffer.size());
+            pbump((int)used);
+        }
+
+        void append(const char* data, std::size_t size) {
+            std::memcpy(pptr(), data, size);
+            setPosition(pending() + size);
+        }
+
+        void reserve(std::size_t extra) {
+            std::size_t used = pending();
+            std::size_t size = m_buffer.size();
+            while (size - used < extra) {
+                size *= 2;
+            }
+            if (size != m_buffer.size()) {
+                m_buffer.resize(size);
+                setPosition(used);
+            }
+        }
+
+        // Copies a run of text that needs no inspection into the buffer.
+        bool writeRun(const char* data, std::size_t size) {
+            if (size <= available()) {
+                append(data, size);
+                return true;
+            }
+            // A frame is written as a whole, the buffer grows to hold it
+            if (m_frames > 0) {
+                reserve(size);
+                append(data, size);
+                return true;
+            }
+            if (m_parent) {
+                // A line is committed as a whole, the buffer grows when a single line does not fit
+                if (!commitLines()) {
+                    return false;
+                }
+                if (size > available()) {
+                    reserve(size);
+                }
+                append(data, size);
+                return true;
+            }
+            if (m_policy == FlushPolicy::OnDestruct) {
+                reserve(size);
+                append(data, size);
+                return true;
+            }
+            // What does not fit goes out by reference together with the buffer, in one writev
+            Segment segments[2] = { { m_buffer.data(), pending() }, { data, size } };
+            setPosition(0);
+#if defined(TERMINAL_STATS)
+            m_counters.buffered(segments[0].size);
+#endif
+            return segments[0].size > 0 ? writeOut(segments, 2) : writeOut(data, size);
+        }
+
+        static constexpr std::size_t IndentRun = detail::SpaceRun.size();
+
+        bool writeIndent() {
+            std::size_t indent = (std::size_t)level * 4;
+            while (indent > 0) {
+                std::size_t run = indent < IndentRun ? indent : IndentRun;
+                if (!writeRun(detail::SpaceRun.data(), run)) {
+                    return false;
+                }
+                indent -= run;
+            }
+            return true;
+        }
+
+        // Copies whole lines at a time, indenting after every newline found by memchr.
+        // Lines that fit into the buffer are copied through a local cursor; the put area
+        // is only updated once per call or when the buffer has to be flushed.
+        bool writeLines(const char* data, std::size_t size) {
+            const std::size_t indent = (std::size_t)level * 4;
+            const char* const pad = detail::SpaceRun.data();
+            char* base = m_buffer.data();
+            char* limit = base + m_buffer.size();
+            char* out = pptr();
+            bool newline = false;
+
+            while (size > 0) {
+                const char* found = (const char*)std::memchr(data, '\n', size);
+                std::size_t run = found ? (std::size_t)(found - data) + 1 : size;
+                std::size_t extra = found ? indent : 0;
+                std::size_t padded = (extra + 15) & ~(std::size_t)15;
+
+                if (padded <= IndentRun && run + padded <= (std::size_t)(limit - out)) {
+                    std::memcpy(out, data, run);
+                    // Spaces are copied in fixed 16 byte blocks, the overshoot is overwritten by the next run
+                    for (std::size_t i = 0; i < padded; i += 16) {
+                        std::memcpy(out + run + i, pad, 16);
+                    }
+                    out += run + extra;
+                } else {
+                    setPosition((std::size_t)(out - base));
+                    if (!writeRun(data, run) || (found && !writeIndent())) {
+                        return false;
+                    }
+                    base = m_buffer.data();
+                    limit = base + m_buffer.size();
+                    out = pptr();
+                }
+                newline = newline || found;
+                data += run;
+                size -= run;
+            }
+            setPosition((std::size_t)(out - base));
+
+            if (newline && m_policy == FlushPolicy::Line && m_frames == 0) {
+                return m_parent ? commitLines() : flushBuffer();
+            }
+            return true;
+        }
+
+        bool flushBuffer() {
+            std::size_t used = pending();
+            if (used == 0) {
+                return true;
+            }
+#if defined(TERMINAL_STATS)
+            m_counters.buffered(used);
+#endif
+            setPosition(0);
+            return writeOut(m_buffer.data(), used);
+        }
+
+        // Writes everything up to the last newline, the unfinished line stays in the buffer
+        bool commitLines() {
+            char* base = m_buffer.data();
+            std::size_t used = pending();
+            std::size_t size = used;
+            while (size > 0 && base[size - 1] != '\n') {
+                size--;
+            }
+            if (size == 0) {
+                return true;
+            }
+#if defined(TERMINAL_STATS)
+            m_counters.buffered(used);
+#endif
+            bool written = writeOut(base, size);
+            std::memmove(base, base + size, used - size);
+            setPosition(used - size);
+            return written;
+        }
+
+        bool writeOut(const char* data, std::size_t size) {
+            const auto& link = m_parent ? m_parent : m_link;
+            std::lock_guard<std::mutex> lock(link->mutex);
+            if (link->owner == nullptr) {
+                return false;
+            }
+            return link->hook ? link->hook->output(*link->owner, data, size) : link->owner->writeDirect(data, size);
+        }
+
+        bool writeOut(const Segment* segments, std::size_t count) {
+            const auto& link = m_parent ? m_parent : m_link;
+            std::lock_guard<std::mutex> lock(link->mutex);
+            if (link->owner == nullptr) {
+                return false;
+            }
+            if (link->hook == nullptr) {
+                return link->owner->writeDirect(segments, count);
+            }
+            for (std::size_t i = 0; i < count; i++) {
+                if (!link->hook->output(*link->owner, segments[i].data, segments[i].size)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Waits for the writer thread, under the lock of m_link so no push runs at the same time
+        bool flushAsync() {
+            std::lock_guard<std::mutex> lock(m_link->mutex);
+            return !m_async || m_async->flush();
+        }
+
+        bool writeDirect(const char* data, std::size_t size) {
+            Segment segment = { data, size };
+            return writeDirect(&segment, 1);
+        }
+
+        // Everything that goes to the sink passes here, under the lock of the link
+        bool writeDirect(const Segment* segments, std::size_t count) {
+#if defined(TERMINAL_STATS)
+            m_counters.handOver(segments, count);
+            detail::WriteCounts before = detail::writeCounts();
+            auto start = std::chrono::steady_clock::now();
+            bool written = sendDirect(segments, count);
+            m_counters.wrote(before, start);
+            return written;
+#else
+            return sendDirect(segments, count);
+#endif
+        }
+
+        bool sendDirect(const Segment* segments, std::size_t count) {
+            if (!m_async && !m_nonBlocking) {
+                return count == 1 ? m_sink->write(segments[0].data, segments[0].size) : m_sink->writev(segments, count);
+            }
+            for (std::size_t i = 0; i < count; i++) {
+                bool written = m_async ? m_async->push(segments[i].data, segments[i].size) :
+                    writeNonBlocking(segments[i].data, segments[i].size);
+                if (!written) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Unsent bytes go first, what the fd does not take now is queued behind them
+        bool writeNonBlocking(const char* data, std::size_t size) {
+            if (!drainUnsent(false)) {
+                return false;
+            }
+            if (m_sent == m_unsent.size()) {
+                long written = m_sink->tryWrite(data, size);
+                if (written < 0) {
+                    m_failedUnreported = true;
+                    return false;
+                }
+                data += written;
+                size -= (std::size_t)written;
+            } else if (m_sent >= m_unsent.size() / 2) {
+                m_unsent.erase(0, m_sent);
+                m_sent = 0;
+            }
+            m_unsent.append(data, size);
+            return true;
+        }
+
+        // Called under the lock of m_link, false on failure. Waits for the fd only when asked to,
+        // otherwise what it does not take stays queued.
+        bool drainUnsent(bool wait) {
+            while (m_sent < m_unsent.size()) {
+                long written = m_sink->tryWrite(m_unsent.data() + m_sent, m_unsent.size() - m_sent);
+                if (written < 0 || (written == 0 && wait && !detail::waitWritable(getFd()))) {
+                    m_unsent.clear();
+                    m_sent = 0;
+                    m_failedUnreported = true;
+                    return false;
+                }
+                if (written == 0 && !wait) {
+                    return true;
+                }
+                m_sent += (std::size_t)written;
+            }
+            m_unsent.clear();
+            m_sent = 0;
+            return true;
+        }
+
+        bool flushNonBlocking() {
+            bool handed = resetPen() && flushBuffer();
+            std::lock_guard<std::mutex> lock(m_link->mutex);
+#if defined(TERMINAL_STATS)
+            detail::WriteCounts before = detail::writeCounts();
+            auto start = std::chrono::steady_clock::now();
+            bool drained = handed && drainUnsent(false);
+            m_counters.wrote(before, start);
+#else
+            bool drained = handed && drainUnsent(false);
+#endif
+            // Failures of earlier writes are reported here as well
+            drained = drained && !m_failedUnreported;
+            m_failedUnreported = false;
+            if (!drained) {
+                setstate(std::ios_base::badbit);
+                return false;
+            }
+            return m_sent == m_unsent.size();
+        }
+
+        void writeMessage(Severity severity, const std::string_view& view) {
+            switch (severity) {
+            case Severity::Success:
+                block(styled<TextColor::White, BackgroundColor::Green>(view).width(80));
+                break;
+            case Severity::Notice:
+                block(styled<TextColor::White, BackgroundColor::Blue>(view).width(80));
+                break;
+            case Severity::Warning:
+                block(styled<TextColor::Blue, BackgroundColor::Yellow>(view).width(80));
+                break;
+            case Severity::Error:
+                block(styled<TextColor::White, BackgroundColor::Red>(view).width(80));
+                break;
+            }
+        }
+
+        // Writes what the overload policy held back: the repeat count of the last message and the drops
+        void reportOverload() {
+            if (!m_overload) {
+                return;
+            }
+            detail::Overload& overload = *m_overload;
+            if (overload.repeats > 0) {
+                *this << "last message repeated " << overload.repeats << (overload.repeats == 1 ? " time\n" : " times\n");
+                overload.repeats = 0;
+            }
+            if (overload.unreported > 0) {
+                *this << overload.unreported << (overload.unreported == 1 ? " message dropped\n" : " messages dropped\n");
+                overload.unreported = 0;
+            }
+        }
+
+        template <class TextStyle>
+        void block(const TextStyle& textStyle) {
+            *this << "\n";
+            *this << textStyle;
+            *this << "\n";
+        }
+    };
+
+    /* Styled stream output */
+
+    namespace detail
+    {
+        // A Styled writes its own sequences, so a deferred or raw pen of the Console is reset first
+        inline bool resetForStyled(std::ostream& out) {
+            Console* console = dynamic_cast<Console*>(&out);
+            return console == nullptr || (console->resetRawPen() && console->resetPen());
+        }
+    }
+
+    /* Style stream output */
+
+    inline std::ostream& operator<<(std::ostream& out, const Style& style) {
+        if (Console* console = dynamic_cast<Console*>(&out)) {
+            console->writeStyle(style);
+            return out;
+        }
+        std::string_view prefix = style.prefix(detail::streamColorLevel(out));
+        out.write(prefix.data(), (std::streamsize)prefix.size());
+        style.writeText(out);
+        if (!prefix.empty()) {
+            out.write("\x1b[m", 3);
+        }
+        return out;
+    }
+
+    /*
+        Escape sequence encoders
+        Each encode() writes one sequence into a caller provided buffer of at least MaxSequenceSize
+        bytes and returns its length. Fixed sequences come from constexpr tables and numbers are
+        formatted with std::to_chars, so nothing is allocated and no locale is involved.
+        The stream operators below are thin wrappers over them.
+    */
+    constexpr std::size_t MaxSequenceSize = 32;
+
+    namespace detail
+    {
+        constexpr std::string_view TerminalSequences[] = {
+            "\x1b" "c",         // ResetDevice
+            "\x1b[7h",          // EnableLineWrap
+            "\x1b[7l",          // DisableLineWrap
+            "\x1b[?2026h",      // BeginSynchronizedUpdate
+            "\x1b[?2026l"       // EndSynchronizedUpdate
+        };
+
+        constexpr std::string_view TabControlSequences[] = {
+            "\x1b" "H",         // SetTab
+            "\x1b[g",           // ClearTab
+            "\x1b[3g"           // ClearAllTab
+        };
+
+        constexpr std::string_view EraseTextSequences[] = {
+            "\x1b[K",           // EraseEndOfLine
+            "\x1b[1K",          // EraseStartOfLine
+            "\x1b[2K",          // EraseLine
+            "\x1b[J",           // EraseDown
+            "\x1b[1J",          // EraseUp
+            "\x1b[2J"           // EraseScreen
+        };
+
+        inline std::size_t copySequence(char* out, std::string_view sequence) {
+            std::memcpy(out, sequence.data(), sequence.size());
+            return sequence.size();
+        }
+
+        // <ESC>[{first}{final}
+        inline std::size_t encodeCsi(char* out, int first, char final) {
+            char* p = out;
+            *p++ = '\x1b';
+            *p++ = '[';
+            p = appendNumber(p, first);
+            *p++ = final;
+            return (std::size_t)(p - out);
+        }
+
+        // <ESC>[{first};{second}{final}
+        inline std::size_t encodeCsi(char* out, int first, int second, char final) {
+            char* p = out;
+            *p++ = '\x1b';
+            *p++ = '[';
+            p = appendNumber(p, first);
+            *p++ = ';';
+            p = appendNumber(p, second);
+            *p++ = final;
+            return (std::size_t)(p - out);
+        }
+    }
+
+    inline std::size_t encode(char* out, Terminal terminal) {
+        return detail::copySequence(out, detail::TerminalSequences[(int)terminal]);
+    }
+
+    inline std::size_t encode(char* out, TabControl value) {
+        return detail::copySequence(out, detail::TabControlSequences[(int)value]);
+    }
+
+    inline std::size_t encode(char* out, EraseText value) {
+        return detail::copySequence(out, detail::EraseTextSequences[(int)value]);
+    }
+
+    inline std::size_t encode(char* out, TextColor color) { return detail::encodeCsi(out, (int)color, 'm'); }
+    inline std::size_t encode(char* out, BackgroundColor color) { return detail::encodeCsi(out, (int)color, 'm'); }
+    inline std::size_t encode(char* out, Attribute sequence) { return detail::encodeCsi(out, (int)sequence, 'm'); }
+
+    inline std::size_t encode(char* out, const Cursor& cursor) {
+        auto operation = cursor.getOperation();
+        switch (operation) {
+        case CursorMovement::Home:
+        case CursorMovement::ForcePosition:
+            return detail::encodeCsi(out, cursor.getCount(), cursor.getColumn(), (char)operation);
+        case CursorMovement::Up:
+        case CursorMovement::Down:
+        case CursorMovement::Forward:
+        case CursorMovement::Backward:
+            return detail::encodeCsi(out, cursor.getCount(), (char)operation);
+        case CursorMovement::SaveCursor:
+            return detail::copySequence(out, "\x1b[s");
+        case CursorMovement::RestoreCursor:
+            return detail::copySequence(out, "\x1b[u");
+        case CursorMovement::SaveCursorAndAttrs:
+            return detail::copySequence(out, "\x1b" "7");
+        case CursorMovement::RestoreCursorAndAttrs:
+            return detail::copySequence(out, "\x1b" "8");
+        case CursorMovement::None:
+            break;
+        }
+        return 0;
+    }
+
+    inline std::size_t encode(char* out, const Scroll& scroll) {
+        switch (scroll.getScrollType()) {
+        case Scrolling::ScrollScreen:
+            return detail::copySequence(out, "\x1b[r");
+        case Scrolling::ScrollFromPosition:
+            return detail::encodeCsi(out, scroll.getStart(), scroll.getEnd(), 'r');
+        case Scrolling::ScrollDown:
+            return detail::copySequence(out, "\x1b" "D");
+        case Scrolling::ScrollUp:
+            return detail::copySequence(out, "\x1b" "M");
+        }
+        return 0;
+    }
+
+    inline std::size_t encode(char* out, const Device& device) {
+        switch (device.getStatus()) {
+        case DeviceStatus::QueryDeviceCode:
+            return detail::copySequence(out, "\x1b[c");
+        case DeviceStatus::ReportDeviceCode: {
+            std::size_t size = detail::encodeCsi(out, device.getCount(), '0');
+            out[size++] = 'c';
+            return size;
+        }
+        case DeviceStatus::QueryDeviceStatus:
+            return detail::copySequence(out, "\x1b[5n");
+        case DeviceStatus::ReportDeviceOK:
+            return detail::copySequence(out, "\x1b[0n");
+        case DeviceStatus::ReportDeviceFailure:
+            return detail::copySequence(out, "\x1b[3n");
+        case DeviceStatus::QueryCursorPosition:
+            return detail::copySequence(out, "\x1b[6n");
+        case DeviceStatus::ReportCursorPosition:
+            return detail::encodeCsi(out, device.getRow(), device.getColumn(), 'R');
+        }
+        return 0;
+    }
+
+    namespace detail
+    {
+        template <class T>
+        std::ostream& writeSequence(std::ostream& out, const T& value) {
+            char sequence[MaxSequenceSize];
+            return out.write(sequence, (std::streamsize)encode(sequence, value));
+        }
+    }
+
+    /* Terminal stream output */
+
+    inline std::ostream& operator<<(std::ostream& out, Terminal terminal) { return detail::writeSequence(out, terminal); }
+
+    /* TabControl stream output */
+
+    inline std::ostream& operator<<(std::ostream& out, TabControl value) { return detail::writeSequence(out, value); }
+
+    /* EraseText stream output */
+
+    inline std::ostream& operator<<(std::ostream& out, EraseText value) { return detail::writeSequence(out, value); }
+
+    /* Color stream output */
+
+    // The Console is told about raw colors and attributes, a Style after them starts from a reset
+    inline std::ostream& operator<<(std::ostream& out, TextColor color) {
+        detail::writeSequence(out, color);
+        if (Console* console = dynamic_cast<Console*>(&out)) {
+            console->rawPen(color == TextColor::None);
+        }
+        return out;
+    }
+
+    inline std::ostream& operator<<(std::ostream& out, BackgroundColor color) {
+        detail::writeSequence(out, color);
+        if (Console* console = dynamic_cast<Console*>(&out)) {
+            console->rawPen(color == BackgroundColor::None);
+        }
+        return out;
+    }
+
+    inline std::ostream& operator<<(std::ostream& out, Attribute sequence) {
+        detail::writeSequence(out, sequence);
+        if (Console* console = dynamic_cast<Console*>(&out)) {
+            console->rawPen(sequence == Attribute::Reset);
+        }
+        return out;
+    }
+
+    /* Cursor Movement Output */
+
+    inline std::ostream& operator<<(std::ostream& out, const Cursor& cursor) { return detail::writeSequence(out, cursor); }
+
+    /* Scroll Output */
+
+    inline std::ostream& operator<<(std::ostream& out, const Scroll& scroll) { return detail::writeSequence(out, scroll); }
+
+    /* Device Output */
+
+    inline std::ostream& operator<<(std::ostream& out, const Device& device) { return detail::writeSequence(out, device); }
 }
\ No newline at end of file
@@ -0,0 +1,795 @@
+#pragma once
+
+#include "Screen.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+/**
+    Headless terminal
+
+    Interprets the sequences this library writes (Cursor, Scroll, EraseText, TabControl,
+    Terminal, Device queries and SGR including 256 and true colors) into a grid of cells,
+    so output can be checked by what ends up on the screen instead of by its bytes.
+
+    It is also a std::ostream, anything written to it is interpreted:
+        VirtualTerminal vt(24, 80);
+        vt << Cursor::home(2, 1) << Style("Hi").red();
+        vt.rowText(1) == "Hi"
+
+    Like a tty with onlcr, '\n' starts a new line at the first column. Characters take the cells
+    of their display width (detail::codepointWidth): a wide character is stored in its first cell
+    and the second holds Cell::WideTail, combining marks take no cell and are not kept. Rows and
+    columns are zero based.
+*/
+namespace terminal
+{
+    class VirtualTerminal : std::streambuf, public std::ostream
+    {
+    private:
+        static constexpr int MaxParameters = 16;
+
+        enum class State : std::uint8_t {
+            Text,
+            Escape,         // after ESC
+            Intermediate,   // ESC followed by 0x20-0x2F (charset selection)
+            Csi,            // ESC [ parameters
+            String,         // ESC ] P X ^ _ until BEL or ESC \ (ST)
+            StringEscape    // ESC inside a string
+        };
+
+        int m_rows;
+        int m_columns;
+        std::vector<Cell> m_cells;
+        // Storage row of every screen row, scrolling rotates these instead of moving cells
+        std::vector<int> m_lines;
+        // Erased row in the current background, copied as a block when rows are cleared
+        std::vector<Cell> m_blankRow;
+        std::vector<std::uint8_t> m_tabs;
+
+        int m_row = 0;
+        int m_column = 0;
+        bool m_wrapPending = false;
+        bool m_lineWrap = true;
+        Pen m_pen;
+        int m_top = 0;
+        int m_bottom = 0;
+
+        // ESC[s / ESC[u keep the position, ESC 7 / ESC 8 the position and pen
+        int m_savedRow = 0;
+        int m_savedColumn = 0;
+        int m_savedAttrsRow = 0;
+        int m_savedAttrsColumn = 0;
+        Pen m_savedPen;
+
+        State m_state = State::Text;
+        bool m_private = false;
+        int m_count = 0;
+        int m_parameters[MaxParameters] = {};
+        char32_t m_codepoint = 0;
+        int m_continuation = 0;
+
+        std::string m_responses;
+        std::uint64_t m_bytes = 0;
+        std::uint64_t m_printed = 0;
+    public:
+        VirtualTerminal(int rows, int columns) : std::ostream(this) { resize(rows, columns); }
+
+        VirtualTerminal(const VirtualTerminal&) = delete;
+        VirtualTerminal& operator=(const VirtualTerminal&) = delete;
+
+        int getRows() const { return m_rows; }
+        int getColumns() const { return m_columns; }
+        int getRow() const { return m_row; }
+        int getColumn() const { return m_column; }
+        const Pen& getPen() const { return m_pen; }
+        bool getLineWrap() const { return m_lineWrap; }
+
+        // Bytes interpreted and cells printed so far, the cost of a redraw is the difference
+        std::uint64_t getBytes() const { return m_bytes; }
+        std::uint64_t getPrinted() const { return m_printed; }
+
+        const Cell& at(int row, int column) const { return line(row)[column]; }
+
+        // Clears the grid, resets the cursor, pen, modes and tab stops (what ESC c does)
+        void reset() {
+            std::fill(m_cells.begin(), m_cells.end(), Cell());
+            for (int row = 0; row < m_rows; row++) {
+                m_lines[(std::size_t)row] = row;
+            }
+            for (int column = 0; column < m_columns; column++) {
+                m_tabs[(std::size_t)column] = column > 0 && column % 8 == 0;
+            }
+            m_row = m_column = 0;
+            m_wrapPending = false;
+            m_lineWrap = true;
+            m_pen = Pen();
+            m_top = 0;
+            m_bottom = m_rows - 1;
+            m_savedRow = m_savedColumn = m_savedAttrsRow = m_savedAttrsColumn = 0;
+            m_savedPen = Pen();
+            m_state = State::Text;
+            m_continuation = 0;
+        }
+
+        void resize(int rows, int columns) {
+            m_rows = rows > 0 ? rows : 1;
+            m_columns = columns > 0 ? columns : 1;
+            m_cells.assign((std::size_t)m_rows * m_columns, Cell());
+            m_lines.assign((std::size_t)m_rows, 0);
+            m_blankRow.assign((std::size_t)m_columns, Cell());
+            m_tabs.assign((std::size_t)m_columns, 0);
+            reset();
+        }
+
+        // Text of a row as UTF-8 without trailing spaces
+        std::string rowText(int row) const {
+            std::string text;
+            const Cell* cells = line(row);
+            int length = m_columns;
+            while (length > 0 && cells[length - 1].codepoint == U' ') {
+                length--;
+            }
+            for (int column = 0; column < length; column++) {
+                if (cells[column].codepoint != Cell::WideTail) {
+                    char utf8[4];
+                    text.append(utf8, detail::encodeUtf8(cells[column].codepoint, utf8));
+                }
+            }
+            return text;
+        }
+
+        // All rows separated by '\n'
+        std::string text() const {
+            std::string text;
+            for (int row = 0; row < m_rows; row++) {
+                text += rowText(row);
+                if (row + 1 < m_rows) {
+                    text += '\n';
+                }
+            }
+            return text;
+        }
+
+        /*
+            Sequences that bring a terminal of the same size to this state: the cells with their pens,
+            the scroll region, line wrap, cursor position and pen. Saved cursors and tab stops are not
+            part of it. Trailing blank cells of a row are left to the erase that starts the snapshot.
+        */
+        std::string snapshot() const {
+            std::string out = "\x1b[r\x1b[m\x1b[2J";
+            char sequence[detail::MaxPenSequence];
+            Pen pen;
+            for (int row = 0; row < m_rows; row++) {
+                const Cell* cells = line(row);
+                int length = m_columns;
+                while (length > 0 && cells[length - 1] == Cell()) {
+                    length--;
+                }
+                if (length == 0) {
+                    continue;
+                }
+                out.append(sequence, encode(sequence, Cursor::home(row + 1, 1)));
+                for (int column = 0; column < length; column++) {
+                    if (cells[column].codepoint == Cell::WideTail) {
+                        continue;
+                    }
+                    if (cells[column].pen != pen) {
+                        out.append(sequence, detail::encodePen(sequence, pen, cells[column].pen));
+                        pen = cells[column].pen;
+                    }
+                    out.append(sequence, detail::encodeUtf8(cells[column].codepoint, sequence));
+                }
+            }
+            out.append(sequence, detail::encodePen(sequence, pen, Pen()));
+            if (m_top != 0 || m_bottom != m_rows - 1) {
+                out.append(sequence, encode(sequence, Scroll::scrollScreen(m_top + 1, m_bottom + 1)));
+            }
+            if (!m_lineWrap) {
+                out.append(sequence, encode(sequence, Terminal::DisableLineWrap));
+            }
+            // Printing the last character again leaves the cursor waiting to wrap as it was
+            int column = m_wrapPending && m_column > 0 && line(m_row)[m_column].codepoint == Cell::WideTail ? m_column - 1 : m_column;
+            out.append(sequence, encode(sequence, Cursor::home(m_row + 1, column + 1)));
+            if (m_wrapPending) {
+                const Cell& cell = line(m_row)[column];
+                out.append(sequence, detail::encodePen(sequence, Pen(), cell.pen));
+                out.append(sequence, detail::encodeUtf8(cell.codepoint, sequence));
+                out.append(sequence, detail::encodePen(sequence, cell.pen, m_pen));
+            } else {
+                out.append(sequence, detail::encodePen(sequence, Pen(), m_pen));
+            }
+            return out;
+        }
+
+        // Reports the terminal would have sent back (cursor position, device status and code)
+        std::string takeResponses() {
+            std::string responses;
+            responses.swap(m_responses);
+            return responses;
+        }
+
+        void write(std::string_view data) { write(data.data(), data.size()); }
+
+        void write(const char* data, std::size_t size) {
+            m_bytes += size;
+            const char* end = data + size;
+            while (data < end) {
+                if (m_state != State::Text) {
+                    data = sequence(data, end);
+                    continue;
+                }
+                unsigned char c = (unsigned char)*data;
+                if (c >= 0x20 && c < 0x7F && m_continuation == 0) {
+                    data = printAscii(data, end);
+                } else if (c >= 0x80 || m_continuation > 0) {
+                    data += decode(c) ? 1 : 0;
+                } else {
+                    control(c);
+                    data++;
+                }
+            }
+        }
+
+    protected:
+        virtual std::streambuf::int_type overflow(std::streambuf::int_type c) {
+            if (!std::streambuf::traits_type::eq_int_type(c, std::streambuf::traits_type::eof())) {
+                char ch = std::streambuf::traits_type::to_char_type(c);
+                write(&ch, 1);
+            }
+            return std::streambuf::traits_type::not_eof(c);
+        }
+
+        virtual std::streamsize xsputn(const char* s, std::streamsize count) {
+            write(s, (std::size_t)count);
+            return count;
+        }
+
+    private:
+        const Cell* line(int row) const { return &m_cells[(std::size_t)m_lines[(std::size_t)row] * m_columns]; }
+        Cell* row(int index) { return &m_cells[(std::size_t)m_lines[(std::size_t)index] * m_columns]; }
+
+        // Erased cells keep the current background color
+        Cell blank() const {
+            Pen pen;
+            pen.background = m_pen.background;
+            return Cell(U' ', pen);
+        }
+
+        void print(char32_t codepoint) {
+            int width = detail::codepointWidth(codepoint);
+            if (width == 0) {
+                return;
+            }
+            width = std::min(width, m_columns);
+            if (m_wrapPending || (width == 2 && m_column + 1 >= m_columns && m_lineWrap)) {
+                // A wide character that does not fit on the row goes to the next one
+                m_column = 0;
+                lineFeed();
+                m_wrapPending = false;
+            } else if (m_column + width > m_columns) {
+                m_column = m_columns - width;
+            }
+            Cell* cells = row(m_row);
+            splitWide(cells, m_column, m_column + width);
+            cells[m_column] = Cell(codepoint, m_pen);
+            if (width == 2) {
+                cells[m_column + 1] = Cell(Cell::WideTail, m_pen);
+            }
+            m_printed++;
+            if (m_column + width < m_columns) {
+                m_column += width;
+            } else {
+                m_column = m_columns - 1;
+                m_wrapPending = m_lineWrap;
+            }
+        }
+
+        // Cells [from, to) are overwritten, a wide character they cut in half is blanked
+        void splitWide(Cell* cells, int from, int to) {
+            if (from > 0 && from < m_columns && cells[from].codepoint == Cell::WideTail) {
+                cells[from - 1].codepoint = U' ';
+            }
+            if (to > 0 && to < m_columns && cells[to].codepoint == Cell::WideTail) {
+                cells[to].codepoint = U' ';
+            }
+        }
+
+        // Printable ASCII run: cells are written directly until the row is full
+        const char* printAscii(const char* data, const char* end) {
+            while (data < end) {
+                if (m_wrapPending || m_column + 1 >= m_columns) {
+                    unsigned char c = (unsigned char)*data;
+                    if (c < 0x20 || c >= 0x7F) {
+                        return data;
+                    }
+                    print(c);
+                    data++;
+                    continue;
+                }
+                // Locals so the stores to cells do not force the members to be reloaded
+                Cell* cells = row(m_row);
+                Cell* out = cells + m_column;
+                if (m_column > 0 && out->codepoint == Cell::WideTail) {
+                    cells[m_column - 1].codepoint = U' ';
+                }
+                const Pen pen = m_pen;
+                const char* stop = data + std::min((std::ptrdiff_t)(m_columns - 1 - m_column), end - data);
+                const char* p = data;
+                while (p < stop) {
+                    unsigned char c = (unsigned char)*p;
+                    if (c < 0x20 || c >= 0x7F) {
+                        break;
+                    }
+                    out->codepoint = c;
+                    out->pen = pen;
+                    out++;
+                    p++;
+                }
+                m_column += (int)(p - data);
+                if (m_column < m_columns && cells[m_column].codepoint == Cell::WideTail) {
+                    cells[m_column].codepoint = U' ';
+                }
+                m_printed += (std::uint64_t)(p - data);
+                if (p < stop) {
+                    return p;
+                }
+                data = p;
+            }
+            return data;
+        }
+
+        // Collects UTF-8 sequences, returns false when c cut a sequence short and has to be read again
+        bool decode(unsigned char c) {
+            if (m_continuation > 0) {
+                if ((c & 0xC0) != 0x80) {
+                    m_continuation = 0;
+                    print(0xFFFD);
+                    return false;
+                }
+                m_codepoint = (m_codepoint << 6) | (c & 0x3F);
+                if (--m_continuation == 0) {
+                    print(m_codepoint);
+                }
+                return true;
+            }
+            if (c >= 0xC0 && c < 0xE0) {
+                m_codepoint = c & 0x1F;
+                m_continuation = 1;
+            } else if (c >= 0xE0 && c < 0xF0) {
+                m_codepoint = c & 0x0F;
+                m_continuation = 2;
+            } else if (c >= 0xF0 && c < 0xF8) {
+                m_codepoint = c & 0x07;
+                m_continuation = 3;
+            } else {
+                print(0xFFFD);
+            }
+            return true;
+        }
+
+        void control(unsigned char c) {
+            switch (c) {
+            case '\x1b':
+                m_state = State::Escape;
+                break;
+            case '\r':
+                m_column = 0;
+                m_wrapPending = false;
+                break;
+            case '\n':
+            case '\v':
+            case '\f':
+                m_column = 0;
+                m_wrapPending = false;
+                lineFeed();
+                break;
+            case '\b':
+                if (m_column > 0) {
+                    m_column--;
+                }
+                m_wrapPending = false;
+                break;
+            case '\t':
+                tab();
+                break;
+            default:
+                break;
+            }
+        }
+
+        void tab() {
+            m_wrapPending = false;
+            while (m_column + 1 < m_columns) {
+                if (m_tabs[(std::size_t)++m_column]) {
+                    break;
+                }
+            }
+        }
+
+        // Moves down, scrolling the region when the cursor is on its last row
+        void lineFeed() {
+            if (m_row == m_bottom) {
+                scrollUp(1);
+            } else if (m_row + 1 < m_rows) {
+                m_row++;
+            }
+        }
+
+        void reverseLineFeed() {
+            m_wrapPending = false;
+            if (m_row == m_top) {
+                scrollDown(1);
+            } else if (m_row > 0) {
+                m_row--;
+            }
+        }
+
+        // Region content moves up by count rows, blank rows come in at the bottom
+        void scrollUp(int count) { shiftRows(m_top, m_bottom, count); }
+        void scrollDown(int count) { shiftRows(m_top, m_bottom, -count); }
+
+        // Shifts rows [first, last] up (count > 0) or down (count < 0), filling the gap with blanks
+        void shiftRows(int first, int last, int count) {
+            int height = last - first + 1;
+            int shift = std::min(count < 0 ? -count : count, height);
+            auto top = m_lines.begin() + first;
+            if (count > 0) {
+                std::rotate(top, top + shift, top + height);
+                clearRows(last - shift + 1, last);
+            } else if (count < 0) {
+                std::rotate(top, top + (height - shift), top + height);
+                clearRows(first, first + shift - 1);
+            }
+        }
+
+        void clearRows(int first, int last) {
+            if (first > last) {
+                return;
+            }
+            if (m_blankRow[0] != blank()) {
+                std::fill(m_blankRow.begin(), m_blankRow.end(), blank());
+            }
+            for (int index = first; index <= last; index++) {
+                std::copy(m_blankRow.begin(), m_blankRow.end(), row(index));
+            }
+        }
+
+        void moveTo(int row, int column) {
+            m_row = std::max(0, std::min(row, m_rows - 1));
+            m_column = std::max(0, std::min(column, m_columns - 1));
+            m_wrapPending = false;
+        }
+
+        void eraseCells(int row, int from, int to) {
+            Cell* cells = this->row(row);
+            splitWide(cells, std::max(from, 0), std::min(to, m_columns));
+            std::fill(cells + std::max(from, 0), cells + std::min(to, m_columns), blank());
+        }
+
+        int parameter(int index, int fallback) const {
+            return index < m_count && m_parameters[index] > 0 ? m_parameters[index] : fallback;
+        }
+
+        int raw(int index) const { return index < m_count ? m_parameters[index] : 0; }
+
+        // Advances through sequence bytes until the sequence ends or the input does
+        const char* sequence(const char* data, const char* end) {
+            while (data < end && m_state != State::Text) {
+                unsigned char c = (unsigned char)*data++;
+                switch (m_state) {
+                case State::Escape:
+                    escape(c);
+                    break;
+                case State::Intermediate:
+                    if (c == 0x1b) {
+                        m_state = State::Escape;
+                    } else if (c < 0x20 || c > 0x2F) {
+                        m_state = State::Text;
+                    }
+                    break;
+                case State::Csi:
+                    if (c >= '0' && c <= '9') {
+                        if (m_count == 0) {
+                            m_count = 1;
+                        }
+                        int& value = m_parameters[m_count - 1];
+                        value = value < 100000 ? value * 10 + (c - '0') : value;
+                    } else if (c == ';' || c == ':') {
+                        if (m_count == 0) {
+                            m_count = 1;
+                        }
+                        if (m_count < MaxParameters) {
+                            m_parameters[m_count++] = 0;
+                        }
+                    } else if (c >= 0x3C && c <= 0x3F) {
+                        m_private = true;
+                    } else if (c >= 0x40 && c <= 0x7E) {
+                        m_state = State::Text;
+                        csi((char)c);
+                    } else if (c == 0x1b) {
+                        // A sequence cut short by a new one is dropped
+                        m_state = State::Escape;
+                    } else if (c < 0x20) {
+                        // Controls inside a sequence are executed
+                        control(c);
+                    }
+                    break;
+                case State::String: {
+                    const char* stop = data - 1;
+                    while (stop < end && *stop != '\a' && *stop != '\x1b') {
+                        stop++;
+                    }
+                    data = stop < end ? stop + 1 : end;
+                    if (stop < end) {
+                        m_state = *stop == '\a' ? State::Text : State::StringEscape;
+                    }
+                    break;
+                }
+                case State::StringEscape:
+                    m_state = c == '\\' ? State::Text : State::Escape;
+                    data -= c == '\\' ? 0 : 1;
+                    break;
+                default:
+                    break;
+                }
+            }
+            return data;
+        }
+
+        void escape(unsigned char c) {
+            m_state = State::Text;
+            switch (c) {
+            case '[':
+                m_state = State::Csi;
+                m_private = false;
+                m_count = 0;
+                std::fill(m_parameters, m_parameters + MaxParameters, 0);
+                break;
+            case ']': case 'P': case 'X': case '^': case '_':
+                m_state = State::String;
+                break;
+            case 'c':
+                reset();
+                break;
+            case 'D':
+                m_wrapPending = false;
+                lineFeed();
+                break;
+            case 'E':
+                m_column = 0;
+                m_wrapPending = false;
+                lineFeed();
+                break;
+            case 'M':
+                reverseLineFeed();
+                break;
+            case 'H':
+                m_tabs[(std::size_t)m_column] = 1;
+                break;
+            case '7':
+                m_savedAttrsRow = m_row;
+                m_savedAttrsColumn = m_column;
+                m_savedPen = m_pen;
+                break;
+            case '8':
+                moveTo(m_savedAttrsRow, m_savedAttrsColumn);
+                m_pen = m_savedPen;
+                break;
+            case '\x1b':
+                m_state = State::Escape;
+                break;
+            default:
+                if (c >= 0x20 && c <= 0x2F) {
+                    m_state = State::Intermediate;
+                }
+                break;
+            }
+        }
+
+        void csi(char final) {
+            switch (final) {
+            case 'A':
+                moveTo(m_row >= m_top ? std::max(m_top, m_row - parameter(0, 1)) : m_row - parameter(0, 1), m_column);
+                break;
+            case 'B':
+                moveTo(m_row <= m_bottom ? std::min(m_bottom, m_row + parameter(0, 1)) : m_row + parameter(0, 1), m_column);
+                break;
+            case 'C':
+                moveTo(m_row, m_column + parameter(0, 1));
+                break;
+            case 'D':
+                moveTo(m_row, m_column - parameter(0, 1));
+                break;
+            case 'E':
+                moveTo(m_row + parameter(0, 1), 0);
+                break;
+            case 'F':
+                moveTo(m_row - parameter(0, 1), 0);
+                break;
+            case 'G':
+                moveTo(m_row, parameter(0, 1) - 1);
+                break;
+            case 'd':
+                moveTo(parameter(0, 1) - 1, m_column);
+                break;
+            case 'H':
+            case 'f':
+                moveTo(parameter(0, 1) - 1, parameter(1, 1) - 1);
+                break;
+            case 'J':
+                eraseDisplay(raw(0));
+                break;
+            case 'K':
+                eraseLine(raw(0));
+                break;
+            case 'X':
+                eraseCells(m_row, m_column, m_column + parameter(0, 1));
+                break;
+            case '@':
+            case 'P':
+                shiftCells(final == '@' ? parameter(0, 1) : -parameter(0, 1));
+                break;
+            case 'L':
+            case 'M':
+                if (m_row >= m_top && m_row <= m_bottom) {
+                    shiftRows(m_row, m_bottom, final == 'L' ? -parameter(0, 1) : parameter(0, 1));
+                    m_column = 0;
+                    m_wrapPending = false;
+                }
+                break;
+            case 'S':
+                scrollUp(parameter(0, 1));
+                break;
+            case 'T':
+                scrollDown(parameter(0, 1));
+                break;
+            case 'r':
+                setRegion(parameter(0, 1) - 1, parameter(1, m_rows) - 1);
+                break;
+            case 's':
+                m_savedRow = m_row;
+                m_savedColumn = m_column;
+                break;
+            case 'u':
+                moveTo(m_savedRow, m_savedColumn);
+                break;
+            case 'g':
+                if (raw(0) == 0) {
+                    m_tabs[(std::size_t)m_column] = 0;
+                } else if (raw(0) == 3) {
+                    std::fill(m_tabs.begin(), m_tabs.end(), 0);
+                }
+                break;
+            case 'h':
+            case 'l':
+                // Line wrap is ESC[?7h in xterm, Terminal::EnableLineWrap writes ESC[7h
+                for (int i = 0; i < std::max(m_count, 1); i++) {
+                    if (raw(i) == 7) {
+                        m_lineWrap = final == 'h';
+                        m_wrapPending = m_wrapPending && m_lineWrap;
+                    }
+                }
+                break;
+            case 'm':
+                graphicRendition();
+                break;
+            case 'n':
+                report(raw(0));
+                break;
+            case 'c':
+                if (!m_private) {
+                    m_responses += "\x1b[?1;2c";
+                }
+                break;
+            default:
+                break;
+            }
+        }
+
+        void eraseDisplay(int mode) {
+            if (mode == 0) {
+                eraseCells(m_row, m_column, m_columns);
+                clearRows(m_row + 1, m_rows - 1);
+            } else if (mode == 1) {
+                clearRows(0, m_row - 1);
+                eraseCells(m_row, 0, m_column + 1);
+            } else if (mode == 2 || mode == 3) {
+                std::fill(m_cells.begin(), m_cells.end(), blank());
+            }
+        }
+
+        void eraseLine(int mode) {
+            if (mode == 0) {
+                eraseCells(m_row, m_column, m_columns);
+            } else if (mode == 1) {
+                eraseCells(m_row, 0, m_column + 1);
+            } else if (mode == 2) {
+                eraseCells(m_row, 0, m_columns);
+            }
+        }
+
+        // Inserts (count > 0) or deletes (count < 0) cells at the cursor, the rest of the row moves
+        void shiftCells(int count) {
+            Cell* cells = row(m_row);
+            int width = m_columns - m_column;
+            int shift = std::min(count < 0 ? -count : count, width);
+            Cell* first = cells + m_column;
+            if (count > 0) {
+                std::move_backward(first, first + (width - shift), first + width);
+                std::fill(first, first + shift, blank());
+            } else {
+                std::move(first + shift, first + width, first);
+                std::fill(first + (width - shift), first + width, blank());
+            }
+            m_wrapPending = false;
+        }
+
+        void setRegion(int top, int bottom) {
+            bottom = std::min(bottom, m_rows - 1);
+            if (top < 0 || top >= bottom) {
+                return;
+            }
+            m_top = top;
+            m_bottom = bottom;
+            moveTo(0, 0);
+        }
+
+        void report(int request) {
+            if (request == 5) {
+                m_responses += "\x1b[0n";
+            } else if (request == 6) {
+                char sequence[MaxSequenceSize];
+                m_responses.append(sequence, encode(sequence, Device::reportCursorPosition(m_row + 1, m_column + 1)));
+            }
+        }
+
+        // 38 / 48 followed by 5;{index} or 2;{r};{g};{b}, returns the number of parameters used
+        int extendedColor(int index, std::uint32_t& color) const {
+            if (raw(index + 1) == 5 && index + 2 < m_count) {
+                color = Pen::indexed(raw(index + 2));
+                return 2;
+            }
+            if (raw(index + 1) == 2 && index + 4 < m_count) {
+                color = Pen::rgb(Color(raw(index + 2), raw(index + 3), raw(index + 4)));
+                return 4;
+            }
+            return m_count - index - 1;
+        }
+
+        void graphicRendition() {
+            if (m_count == 0) {
+                m_pen = Pen();
+                return;
+            }
+            for (int i = 0; i < m_count; i++) {
+                int code = m_parameters[i];
+                switch (code) {
+                case 0: m_pen = Pen(); break;
+                case 1: m_pen.attributes |= Pen::Bold; break;
+                case 2: m_pen.attributes |= Pen::Dim; break;
+                case 4: m_pen.attributes |= Pen::Underscore; break;
+                case 5: m_pen.attributes |= Pen::Blink; break;
+                case 7: m_pen.attributes |= Pen::Reverse; break;
+                case 8: m_pen.attributes |= Pen::Hidden; break;
+                case 22: m_pen.attributes &= (std::uint8_t)~(Pen::Bold | Pen::Dim); break;
+                case 24: m_pen.attributes &= (std::uint8_t)~Pen::Underscore; break;
+                case 25: m_pen.attributes &= (std::uint8_t)~Pen::Blink; break;
+                case 27: m_pen.attributes &= (std::uint8_t)~Pen::Reverse; break;
+                case 28: m_pen.attributes &= (std::uint8_t)~Pen::Hidden; break;
+                case 38: i += extendedColor(i, m_pen.text); break;
+                case 39: m_pen.text = Pen::NoColor; break;
+                case 48: i += extendedColor(i, m_pen.background); break;
+                case 49: m_pen.background = Pen::NoColor; break;
+                default:
+                    if ((code >= 30 && code <= 37) || (code >= 90 && code <= 97)) {
+                        m_pen.text = Pen::basic(code);
+                    } else if ((code >= 40 && code <= 47) || (code >= 100 && code <= 107)) {
+                        m_pen.background = Pen::basic(code);
+                    }
+                    break;
+                }
+            }
+        }
+    };
+}
@@ -0,0 +1 @@
+g++ -std=c++17 -O2 Benchmark.cpp -o Benchmark.exe && Benchmark.exe
\ No newline at end of file
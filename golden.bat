@@ -0,0 +1 @@
+g++ -std=c++17 -O2 Golden.cpp -o Golden.exe && Golden.exe
\ No newline at end of file
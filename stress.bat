@@ -0,0 +1 @@
+g++ -std=c++17 -O2 Stress.cpp -o Stress.exe && Stress.exe
\ No newline at end of file